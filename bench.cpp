@@ -0,0 +1,459 @@
+/**
+ * Benchmarks for Search100
+ *
+ * This file measures the performance of stemming, indexing, loading indexes and
+ * searching on a synthetic corpus. Words of corpus are drawn from a Zipfian
+ * distribution, like words of natural language text, so that posting lists have
+ * realistic lengths: a few terms occur in most documents while most terms are rare.
+ *
+ * The corpus and indexes are written to a search100_bench/ directory inside the
+ * given directory (bench_data/ by default), which is cleared on every run; the
+ * corpus and indexes of application are never touched. Results are
+ * printed as text, or as a single JSON object with --format json for tracking
+ * performance across changes.
+ *
+ * $ make bench
+ * $ ./search100-bench --documents 5000 --format json
+ *
+ * Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025
+ *
+ * */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "src/engine.cpp"
+#include "src/utils.cpp"
+
+const std::string BENCH_USAGE =
+    "Usage: search100-bench [options]\n"
+    "\n"
+    "Options:\n"
+    "  --documents <n>    The number of documents of corpus. (default: 2000)\n"
+    "  --words <n>        The number of words in each document. (default: 500)\n"
+    "  --vocabulary <n>   The number of distinct words. (default: 20000)\n"
+    "  --zipf <s>         The exponent of Zipfian distribution of words. (default: 1.0)\n"
+    "  --queries <n>      The number of queries of each strategy. (default: 1000)\n"
+    "  --limit <n>        The maximum number of results of each query, 0 for all. (default: 10)\n"
+    "  --seed <n>         The seed of random generator. (default: 100)\n"
+    "  --dir <path>       The directory to create the benchmark directory in. (default: bench_data/)\n"
+    "  --format <name>    The output format, text or json. (default: text)\n";
+
+/**
+ * @brief The number of words in each line of generated documents.
+ */
+const int BENCH_WORDS_PER_LINE = 12;
+
+/**
+ * @brief The number of times indexes are loaded to measure load time.
+ */
+const int BENCH_LOAD_RUNS = 5;
+
+/**
+ * @brief The directory inside --dir that corpus and indexes are written to. It is
+ * only ever created by benchmarks, so it is safe to clear.
+ */
+const std::string BENCH_DIRECTORY_NAME = "search100_bench";
+
+/**
+ * @brief The options of benchmarks, see BENCH_USAGE.
+ */
+class BenchOptions
+{
+    public:
+
+    size_t documents = 2000;
+    size_t words = 500;
+    size_t vocabulary = 20000;
+    double zipf = 1.0;
+    size_t queries = 1000;
+    size_t limit = 10;
+    uint64_t seed = 100;
+    std::string dir = "bench_data/";
+    bool json = false;
+};
+
+/**
+ * @brief Draws words from a vocabulary with Zipfian distribution: the probability
+ * of k-th most frequent word is proportional to 1 / k^s.
+ */
+class ZipfianWords
+{
+    std::vector<std::string> words;
+    std::vector<double> cumulative;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+
+    public:
+
+    /**
+     * @param vocabulary: The number of distinct words.
+     * @param exponent: The exponent (s) of distribution.
+     * @param random: The random generator to generate words with.
+     */
+    ZipfianWords(size_t vocabulary, double exponent, std::mt19937_64 &random)
+    {
+        // Words are made of syllables and common English suffixes so that the
+        // stemmer goes through the same steps as it does for real text.
+        const std::vector<std::string> onsets = {"b", "c", "d", "f", "g", "h", "l", "m", "n", "p", "r", "s", "t", "v",
+                                                 "br", "cr", "st", "tr", "pl", "gr", "sh", "ch", "th"};
+        const std::vector<std::string> vowels = {"a", "e", "i", "o", "u", "ea", "ou", "ai"};
+        const std::vector<std::string> suffixes = {"", "", "", "s", "ing", "ed", "ation", "ness", "ly", "ment", "er",
+                                                   "ize", "ful", "ity", "ous", "ive", "able"};
+        std::set<std::string> seen;
+
+        while (words.size() < vocabulary)
+        {
+            std::string word;
+            size_t syllables = 1 + random() % 3;
+
+            for (size_t i = 0; i < syllables; i++)
+                word += onsets[random() % onsets.size()] + vowels[random() % vowels.size()];
+
+            word += onsets[random() % onsets.size()] + suffixes[random() % suffixes.size()];
+
+            if (seen.insert(word).second)
+                words.push_back(word);
+        }
+
+        double total = 0;
+        for (size_t i = 0; i < vocabulary; i++)
+        {
+            total += 1.0 / std::pow(i + 1, exponent);
+            cumulative.push_back(total);
+        }
+
+        for (double &value : cumulative)
+            value /= total;
+    }
+
+    /**
+     * @brief Draws a word.
+     */
+    const std::string &next(std::mt19937_64 &random)
+    {
+        size_t rank = std::lower_bound(cumulative.begin(), cumulative.end(), uniform(random)) - cumulative.begin();
+        return words[std::min(rank, words.size() - 1)];
+    }
+};
+
+/**
+ * @brief The latency percentiles of a set of queries.
+ */
+class LatencySummary
+{
+    public:
+
+    double mean_ms = 0;
+    double p50_ms = 0;
+    double p95_ms = 0;
+    double p99_ms = 0;
+    double max_ms = 0;
+    double queries_per_second = 0;
+    double results_per_query = 0;
+};
+
+/**
+ * @brief Parses command line arguments. Throws a string describing the error if
+ * arguments are invalid.
+ */
+BenchOptions parseBenchOptions(int argc, char* argv[])
+{
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help")
+            throw std::string();
+        if (i + 1 >= argc)
+            throw "Option " + arg + " expects a value.";
+
+        std::string value = argv[++i];
+        bool numeric = !value.empty() && value.size() <= 9 && std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); });
+
+        if (arg == "--dir")
+            options.dir = value;
+        else if (arg == "--format")
+        {
+            if (value != "text" && value != "json")
+                throw "Unknown output format: " + value;
+
+            options.json = value == "json";
+        }
+        else if (arg == "--zipf")
+        {
+            try
+            {
+                options.zipf = std::stod(value);
+            }
+            catch (const std::exception&)
+            {
+                throw std::string("Option --zipf expects a number.");
+            }
+        }
+        else if (!numeric)
+            throw "Option " + arg + " expects a non-negative integer of at most nine digits.";
+        else if (arg == "--documents")
+            options.documents = std::stoull(value);
+        else if (arg == "--words")
+            options.words = std::stoull(value);
+        else if (arg == "--vocabulary")
+            options.vocabulary = std::stoull(value);
+        else if (arg == "--queries")
+            options.queries = std::stoull(value);
+        else if (arg == "--limit")
+            options.limit = std::stoull(value);
+        else if (arg == "--seed")
+            options.seed = std::stoull(value);
+        else
+            throw "Unknown option: " + arg;
+    }
+
+    if (!options.documents || !options.words || !options.vocabulary)
+        throw std::string("Corpus must have at least one document, word and distinct word.");
+
+    return options;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief Runs queries one after another and summarizes their latencies.
+ */
+LatencySummary runQueries(const SearchEngine &engine, const std::vector<std::string> &queries,
+                          bool search_strategy_and, size_t limit)
+{
+    std::vector<double> latencies;
+    size_t result_count = 0;
+    auto started = std::chrono::steady_clock::now();
+
+    for (const std::string &query : queries)
+    {
+        auto query_started = std::chrono::steady_clock::now();
+        result_count += engine.search(query, search_strategy_and, limit).size();
+        latencies.push_back(secondsSince(query_started) * 1000);
+    }
+
+    double elapsed = secondsSince(started);
+    LatencySummary summary;
+    if (latencies.empty())
+        return summary;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t) (p / 100 * latencies.size()))];
+    };
+
+    for (double latency : latencies)
+        summary.mean_ms += latency / latencies.size();
+
+    summary.p50_ms = percentile(50);
+    summary.p95_ms = percentile(95);
+    summary.p99_ms = percentile(99);
+    summary.max_ms = latencies.back();
+    summary.queries_per_second = elapsed > 0 ? latencies.size() / elapsed : 0;
+    summary.results_per_query = (double) result_count / latencies.size();
+    return summary;
+}
+
+nlohmann::json summaryToJSON(const LatencySummary &summary)
+{
+    return {
+        {"mean_ms", summary.mean_ms},
+        {"p50_ms", summary.p50_ms},
+        {"p95_ms", summary.p95_ms},
+        {"p99_ms", summary.p99_ms},
+        {"max_ms", summary.max_ms},
+        {"queries_per_second", summary.queries_per_second},
+        {"results_per_query", summary.results_per_query}
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+
+    try
+    {
+        options = parseBenchOptions(argc, argv);
+    }
+    catch (const std::string &message)
+    {
+        if (message.empty())
+        {
+            std::cout << BENCH_USAGE;
+            return 0;
+        }
+
+        std::cerr << message << "\n\n" << BENCH_USAGE;
+        return 2;
+    }
+
+    // Indexing logs a line for every document, which would be measured too.
+    std::ofstream discarded;
+    log_stream = &discarded;
+
+    std::filesystem::path directory = std::filesystem::path(options.dir) / BENCH_DIRECTORY_NAME;
+    std::filesystem::create_directories(directory);
+    std::filesystem::current_path(directory);
+    std::filesystem::remove_all("corpus");
+    std::filesystem::create_directories("corpus");
+    std::filesystem::remove(INDEX_SEGMENT_FILENAME);
+
+    std::mt19937_64 random(options.seed);
+    ZipfianWords words(options.vocabulary, options.zipf, random);
+
+    // Corpus
+    std::vector<std::string> lines;
+    uint64_t corpus_bytes = 0;
+
+    for (size_t document = 0; document < options.documents; document++)
+    {
+        std::string content;
+
+        for (size_t i = 0; i < options.words; i++)
+        {
+            const std::string &word = words.next(random);
+            size_t line_end = lines.size();
+
+            if (i % BENCH_WORDS_PER_LINE == 0)
+                lines.emplace_back();
+            else
+                lines[line_end - 1] += ' ';
+
+            lines.back() += word;
+            content += word;
+            content += (i % BENCH_WORDS_PER_LINE == BENCH_WORDS_PER_LINE - 1 || i + 1 == options.words) ? '\n' : ' ';
+        }
+
+        std::ofstream file("corpus/doc" + std::to_string(document) + ".txt", std::ios::binary);
+        file << content;
+        corpus_bytes += content.size();
+    }
+
+    // Stemming
+    uint64_t stemmed_words = 0;
+    auto started = std::chrono::steady_clock::now();
+    {
+        PorterStemmer stemmer;
+        for (const std::string &line : lines)
+            stemmed_words += stemmer.stemLine(line).size();
+    }
+    double stem_seconds = secondsSince(started);
+
+    StemCache stem_cache;
+    started = std::chrono::steady_clock::now();
+    {
+        PorterStemmer stemmer(&stem_cache);
+        for (const std::string &line : lines)
+            stemmer.stemLine(line);
+    }
+    double cached_stem_seconds = secondsSince(started);
+    lines.clear();
+
+    // Indexing
+    double index_seconds;
+    {
+        SearchEngine engine("corpus/");
+        started = std::chrono::steady_clock::now();
+        engine.indexCorpusDirectory(false);
+        index_seconds = secondsSince(started);
+    }
+
+    // Loading indexes
+    std::vector<double> load_times;
+    for (int i = 0; i < BENCH_LOAD_RUNS; i++)
+    {
+        SearchEngine engine("corpus/");
+        started = std::chrono::steady_clock::now();
+        engine.indexCorpusDirectory(true);
+        load_times.push_back(secondsSince(started) * 1000);
+    }
+    std::sort(load_times.begin(), load_times.end());
+
+    // Searching. The result cache is disabled so that every query searches the index.
+    SearchEngine engine("corpus/");
+    engine.indexCorpusDirectory(true);
+    engine.setResultCacheCapacity(0);
+
+    std::vector<std::string> and_queries, or_queries;
+    for (size_t i = 0; i < options.queries; i++)
+    {
+        std::string and_query = words.next(random) + " " + words.next(random);
+        if (i % 2)
+            and_query += " " + words.next(random);
+
+        std::string or_query = words.next(random) + " " + words.next(random) + " " + words.next(random);
+        if (i % 2)
+            or_query += " " + words.next(random);
+
+        and_queries.push_back(and_query);
+        or_queries.push_back(or_query);
+    }
+
+    LatencySummary and_summary = runQueries(engine, and_queries, true, options.limit);
+    LatencySummary or_summary = runQueries(engine, or_queries, false, options.limit);
+
+    double stem_rate = stem_seconds > 0 ? stemmed_words / stem_seconds : 0;
+    double cached_stem_rate = cached_stem_seconds > 0 ? stemmed_words / cached_stem_seconds : 0;
+    double index_rate = index_seconds > 0 ? corpus_bytes / index_seconds / (1024 * 1024) : 0;
+    double load_ms = load_times[load_times.size() / 2];
+
+    if (options.json)
+    {
+        nlohmann::json result = {
+            {"config", {
+                {"documents", options.documents},
+                {"words", options.words},
+                {"vocabulary", options.vocabulary},
+                {"zipf", options.zipf},
+                {"queries", options.queries},
+                {"limit", options.limit},
+                {"seed", options.seed},
+                {"hardware_threads", std::thread::hardware_concurrency()}
+            }},
+            {"corpus_bytes", corpus_bytes},
+            {"indexed_terms", engine.getSegment() ? engine.getSegment()->termCount() : 0},
+            {"stemming", {
+                {"words", stemmed_words},
+                {"words_per_second", stem_rate},
+                {"cached_words_per_second", cached_stem_rate}
+            }},
+            {"indexing", {{"seconds", index_seconds}, {"mb_per_second", index_rate}}},
+            {"loading", {{"median_ms", load_ms}}},
+            {"search_and", summaryToJSON(and_summary)},
+            {"search_or", summaryToJSON(or_summary)}
+        };
+
+        std::cout << result.dump(2) << std::endl;
+        return 0;
+    }
+
+    auto printSummary = [](const std::string &name, const LatencySummary &summary)
+    {
+        std::cout << "Search (" << name << "):  p50 " << summary.p50_ms << " ms, p95 " << summary.p95_ms
+                  << " ms, p99 " << summary.p99_ms << " ms, max " << summary.max_ms << " ms, "
+                  << summary.queries_per_second << " queries/s, " << summary.results_per_query << " results/query\n";
+    };
+
+    std::cout << "Corpus:        " << options.documents << " documents, " << corpus_bytes / (1024.0 * 1024) << " MB, "
+              << options.vocabulary << " distinct words (zipf " << options.zipf << ")\n";
+    std::cout << "Stemming:      " << stem_rate << " words/s, " << cached_stem_rate << " words/s with cache\n";
+    std::cout << "Indexing:      " << index_seconds << " s, " << index_rate << " MB/s\n";
+    std::cout << "Loading:       " << load_ms << " ms (median of " << BENCH_LOAD_RUNS << ")\n";
+    printSummary("AND", and_summary);
+    printSummary("OR", or_summary);
+
+    return 0;
+}
@@ -3,19 +3,55 @@
 #ifndef _SEARCH100_ENGINE
 #define _SEARCH100_ENGINE
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
 #include <filesystem>
 #include <fstream>
-#include <set>
+#include <thread>
 #include <tuple>
 #include "json.hpp"
+#include "query.cpp"
+#include "result_cache.cpp"
+#include "thread_pool.cpp"
+#include "scoring.cpp"
+#include "segment.cpp"
 #include "stemming.cpp"
 
 /**
- * @brief Describes search result for a specific term in query.
+ * @brief The file that the index segment is stored in.
+ */
+const std::string INDEX_SEGMENT_FILENAME = "index.s100";
+
+/**
+ * @brief The file that a new index segment is written to before it replaces the current one.
+ */
+const std::string PENDING_INDEX_SEGMENT_FILENAME = INDEX_SEGMENT_FILENAME + ".tmp";
+
+/**
+ * @brief The ratio of document frequencies of the two rarest terms of an 'AND' query
+ * from which their posting lists are intersected by galloping instead of block by block.
+ */
+const uint32_t GALLOPING_INTERSECTION_RATIO = 16;
+
+/**
+ * @brief The number of postings worth scoring on a separate thread.
+ * 
+ * OR queries whose terms have at least twice as many postings in total are
+ * scored in parallel, with at least this many postings in each part.
+ */
+const uint64_t PARALLEL_SCORING_POSTINGS = 1 << 16;
+
+/**
+ * @brief Describes search result for a document that matches the query.
  * 
  */
 class SearchResult
@@ -23,9 +59,9 @@ class SearchResult
     public:
 
     /**
-     * @brief The term in search query that this result refers to.
+     * @brief The IDs of searched terms that occur in the document.
      */
-    Stem query_term;
+    std::vector<uint32_t> term_ids;
 
     /**
      * @brief The ID of document that this result refers to.
@@ -33,14 +69,199 @@ class SearchResult
     int document_id;
 
     /**
-     * @brief The relevance (TF-IDF) score of the result.
+     * @brief The relevance score of the result, i.e. sum of scores of searched
+     * terms in the document by the ranking function used.
      */
     double relevance_score;
     
     /**
-     * @brief The occurrences of the searched term in the given document.
+     * @brief The postings of searched terms in the document, in order of `term_ids`.
+     * 
+     * Postings refer to the positions of terms in segment, which are only decoded
+     * into occurrences by getOccurrences() so that results that are never shown
+     * do not allocate their occurrences.
+     */
+    std::vector<SegmentPosting> postings;
+
+    /**
+     * @brief The index segment that this result was read from.
+     * 
+     * Document, term and word IDs are only valid in this segment. The segment
+     * stays mapped as long as the result exists, even if documents are reindexed.
+     */
+    std::shared_ptr<const IndexSegment> segment;
+
+    /**
+     * @brief Gets the path of document that this result refers to.
+     */
+    std::filesystem::path getDocumentPath() const
+    {
+        return segment->documentPath(document_id);
+    }
+
+    /**
+     * @brief Gets the number of occurrences of searched terms in the document,
+     * without decoding them.
+     */
+    uint32_t getOccurrenceCount() const
+    {
+        uint32_t count = 0;
+        for (auto &posting : postings)
+            count += posting.occurrence_count;
+
+        return count;
+    }
+
+    /**
+     * @brief Decodes the occurrences of all searched terms in the document.
+     * 
+     * @returns vector<Occurrence> - the occurrences in order they occur in document.
+     */
+    std::vector<Occurrence> getOccurrences() const
+    {
+        std::vector<Occurrence> occurrences;
+        occurrences.reserve(getOccurrenceCount());
+
+        for (size_t i = 0; i < postings.size(); i++)
+        {
+            auto term_occurrences = segment->occurrences(segment->termAt(term_ids[i]), postings[i]);
+            occurrences.insert(occurrences.end(), term_occurrences.begin(), term_occurrences.end());
+        }
+
+        std::sort(occurrences.begin(), occurrences.end(), [](const Occurrence &a, const Occurrence &b) {
+            return (a.line != b.line) ? (a.line < b.line) : (a.index < b.index);
+        });
+
+        return occurrences;
+    }
+
+    /**
+     * @brief Gets the original (unstemmed) word of an occurrence.
+     */
+    std::string getSurfaceForm(const Occurrence &occurrence) const
+    {
+        return std::string(segment->surfaceString(occurrence.surface_id));
+    }
+};
+
+
+/**
+ * @brief An immutable generation of index that queries are served from.
+ * 
+ * Each indexing run publishes a new snapshot; snapshots are never modified once
+ * published, so any number of queries may read one while the next is built.
+ */
+class IndexSnapshot
+{
+    public:
+
+    /**
+     * @brief The memory mapped index segment, or nullptr if no documents are indexed.
+     */
+    std::shared_ptr<const IndexSegment> segment;
+
+    /**
+     * @brief The generation of snapshot, incremented with each published snapshot.
+     */
+    uint64_t generation = 0;
+};
+
+/**
+ * @brief A parsed search query, along with the index segment and ranking options
+ * that it is run with.
+ */
+class PreparedQuery
+{
+    public:
+
+    QueryNode query;
+    std::shared_ptr<const IndexSegment> segment;
+
+    /* The generation of segment, see SearchEngine::setSegment(). */
+    uint64_t generation = 0;
+
+    RankingFunction ranking = RankingFunction::TF_IDF;
+    double bm25_k1 = 1.2;
+    double bm25_b = 0.75;
+};
+
+/**
+ * @brief Opaque position in the results of a search, used to fetch the next page.
+ * 
+ * The cursor keeps the index segment that the first page was read from so that
+ * all pages are read from the same segment, even if documents are reindexed
+ * while paging.
+ */
+class SearchCursor
+{
+    friend class SearchEngine;
+
+    PreparedQuery prepared;
+    size_t page_size = 0;
+
+    /* The document ID and relevance score of last result returned. */
+    std::pair<int, double> last{-1, 0.0};
+    bool has_more = false;
+
+    public:
+
+    /**
+     * @brief Whether there are more results after the ones returned so far.
+     */
+    bool hasMore() const
+    {
+        return has_more;
+    }
+};
+
+/**
+ * @brief A page of search results, see SearchEngine::searchPage().
+ */
+class SearchPage
+{
+    public:
+
+    /**
+     * @brief The results of page in descending order of relevance.
+     */
+    std::vector<SearchResult> results;
+
+    /**
+     * @brief The cursor to fetch next page with, see SearchEngine::nextPage().
      */
-    std::vector<Occurrence> occurrences;
+    SearchCursor cursor;
+};
+
+/**
+ * @brief Describes the progress of indexing documents.
+ */
+class IndexingProgress
+{
+    public:
+
+    /* The number of documents indexed so far, and the number of documents to index. */
+    uint64_t files_done = 0;
+    uint64_t files_total = 0;
+
+    /* The size of documents indexed so far, and of all documents to index. */
+    uint64_t bytes_done = 0;
+    uint64_t bytes_total = 0;
+
+    /* The time elapsed since indexing of documents started. */
+    double elapsed_seconds = 0;
+
+    /**
+     * @brief Estimates the time remaining until all documents are indexed.
+     * 
+     * @returns double - the estimated seconds or -1 if no document is indexed yet.
+     */
+    double getRemainingSeconds() const
+    {
+        if (!bytes_done)
+            return -1;
+
+        return elapsed_seconds * (bytes_total - bytes_done) / bytes_done;
+    }
 };
 
 
@@ -49,306 +270,1265 @@ class SearchResult
  * 
  * This class manages all the searching and indexing processes and
  * keeps the indices cache.
+ * 
+ * Searching and the other const methods may be called from any number of
+ * threads at once, including while documents are being reindexed; each query
+ * reads the index snapshot that was current when it started.
  */
 class SearchEngine
 {
-    /* Maps document ID to path of that document. */
-    std::map<int, std::filesystem::path> documents;
-
     /**
-     * @brief Maps document ID to a map of all terms in that document.
+     * @brief The index snapshot that queries are served from.
      * 
-     * If term1 and term2 occurs in document with document_id, then the mapping
-     * looks like the following:
+     * Each indexing run produces a new segment that replaces this one once it
+     * is written. The snapshot is only read and replaced with atomic operations,
+     * and queries take a reference to it when they start, so they are served from
+     * the same segment throughout without blocking each other or indexing.
+     */
+    std::shared_ptr<const IndexSnapshot> snapshot = std::make_shared<const IndexSnapshot>();
+
+    /* The generation of last published snapshot. */
+    std::atomic<uint64_t> snapshot_generation{0};
+
+    /* The background indexing thread, see startIndexing(). The thread is only
+       joined or replaced with indexing_thread_mutex held. */
+    std::thread indexing_thread;
+    std::mutex indexing_thread_mutex;
+    std::atomic<bool> indexing{false};
+
+    /* Progress of current indexing run, see getIndexingProgress(). */
+    std::atomic<uint64_t> progress_files_done{0};
+    std::atomic<uint64_t> progress_files_total{0};
+    std::atomic<uint64_t> progress_bytes_done{0};
+    std::atomic<uint64_t> progress_bytes_total{0};
+    std::atomic<int64_t> progress_started{0};
+
+    /**
+     * @brief The in-memory index that documents are indexed into.
      * 
-     * { document_id: {term1: [Occurrence, ...], term2: [Occurrence, ...] } }
+     * This is only used as a buffer while indexing documents. Once indexing
+     * finishes, it is written to the segment and cleared.
+     */
+    InvertedIndex index;
+
+    /**
+     * @brief Cache of stems shared by indexing threads and search queries.
      * 
-     * */
-    std::map<int, std::map<std::string, std::vector<Occurrence>>> term_occurrences;
+     * Caches are thread safe and do not change results, so they may be updated
+     * by const queries.
+     */
+    mutable StemCache stem_cache;
 
-    /* Maps a term to vector of document IDs in which it occurs. */
-    std::map<std::string, std::set<int>> term_documents;
+    /**
+     * @brief Cache of search results, keyed on normalized query and search options.
+     */
+    mutable ResultCache<std::vector<SearchResult>> result_cache;
 
-    /* Used to track largest document IDs */
-    int doc_id_tracker = -1;
+    /* The threads that large queries are scored on, see getQueryPool(). */
+    mutable std::unique_ptr<ThreadPool> query_pool;
+    mutable std::once_flag query_pool_created;
 
     /**
-     * @brief Loads indexes from data on disk.
+     * @brief Loads indexes from legacy JSON data on disk.
+     *
+     * Older versions of Search100 stored the indexes in three JSON files. These
+     * are only loaded to migrate them to an index segment.
      */
     void loadFromFiles() {
         nlohmann::json documents_json = readJSON("documents.json");
         nlohmann::json term_occurrences_json = readJSON("term_occurrences.json");
-        nlohmann::json term_documents_json = readJSON("term_documents.json");
 
         for (nlohmann::json::iterator iter = documents_json.begin(); iter != documents_json.end(); ++iter) {
             int document_id = iter.value();
-            documents[document_id] = std::filesystem::path(iter.key());
+            std::vector<std::pair<uint32_t, IndexedPosition>> doc_occurrences;
+            index.documents[document_id].path = std::filesystem::path(iter.key());
 
             for (auto &[term, occurrences] : term_occurrences_json[std::to_string(document_id)].items())
             {
+                uint32_t term_id = index.getTermId(term);
                 for (auto &occurrence : occurrences)
                 {
-                    Occurrence parsed;
-                    parsed.document_id = document_id;
-                    parsed.stemmed = term;
-                    parsed.original = occurrence["original"];
+                    IndexedPosition parsed;
+                    parsed.surface_id = index.getSurfaceId(occurrence["original"]);
                     parsed.index = occurrence["index"];
                     parsed.line = occurrence["line"];
-                    term_occurrences[document_id][term].push_back(parsed);
+                    doc_occurrences.emplace_back(term_id, parsed);
                 }
             }
+
+            // Legacy indexes do not record word positions, so words are numbered in
+            // order they occur. This does not count the stop words between them.
+            std::sort(doc_occurrences.begin(), doc_occurrences.end(), [](const auto &a, const auto &b) {
+                return (a.second.line != b.second.line) ? (a.second.line < b.second.line) : (a.second.index < b.second.index);
+            });
+
+            for (size_t i = 0; i < doc_occurrences.size(); i++)
+                doc_occurrences[i].second.position = i;
+
+            index.addOccurrences(document_id, doc_occurrences);
         }
 
-        term_documents = term_documents_json.get<std::map<std::string, std::set<int>>>();
+        // JSON objects are ordered by path rather than document ID
+        index.sortPostings();
     }
 
     /**
      * @brief Indexes the given file.
      * 
-     * @param file: The path object for file to index.
-     * @param documents_json: The JSON object to add document data to.
-     * @param term_occurrences_json: The JSON object to add terms data to.
-     * @param term_documents_json: The JSON object to add occurrence documents data to.
+     * This method only modifies the given partial index so it can be called
+     * from multiple indexing threads simultaneously.
+     * 
+     * @param path: The path of file to index.
+     * @param document_id: The ID to assign to the document.
+     * @param partial_index: The partial index to add the document to.
      */
-    void indexDocument(
-        const std::filesystem::directory_entry &file,
-        nlohmann::json &documents_json,
-        nlohmann::json &term_occurrences_json,
-        nlohmann::json &term_documents_json
-    )
+    void indexDocument(const std::filesystem::path &path, int document_id, InvertedIndex &partial_index)
     {
-        std::filesystem::path path(file.path());
-        std::ifstream fs(path);
-        std::string line;
-        PorterStemmer stemmer;
+        std::string content = readFile(path);
+        PorterStemmer stemmer(&stem_cache);
+
+        DocumentInfo &info = partial_index.documents[document_id];
+        info.path = path;
+        info.file_size = content.size();
+        info.modified_time = getFileModifiedTime(path);
+        info.content_hash = hashFNV1a(content);
 
+        std::vector<std::pair<uint32_t, IndexedPosition>> doc_occurrences;
         int lineno = 0;
-        int document_id = ++doc_id_tracker;
-        std::string document_id_str = std::to_string(document_id);  // for JSON
+        int word_position = 0;
+        size_t start = 0;
+
+        // Lines are split in the same way as getline() does i.e. a newline
+        // at the end of file does not begin another (empty) line.
+        while (start < content.size())
+        {
+            size_t end = content.find('\n', start);
+            if (end == std::string::npos)
+                end = content.size();
+
+            std::vector<Stem> stems = stemmer.stemLine(std::string_view(content).substr(start, end - start), word_position);
+            for (Stem &stem : stems)
+            {
+                IndexedPosition position;
+                position.line = lineno;
+                position.index = stem.index;
+                position.position = stem.position;
+                position.surface_id = partial_index.getSurfaceId(stem.original);
+                doc_occurrences.emplace_back(partial_index.getTermId(stem.stemmed), position);
+            }
+
+            lineno++;
+            start = end + 1;
+        }
+
+        partial_index.addOccurrences(document_id, doc_occurrences);
+
+        progress_files_done++;
+        progress_bytes_done += content.size();
+    }
+
+    /**
+     * @brief Checks whether a document changed since it was indexed.
+     * 
+     * Size and modification time of file are compared first. If only the
+     * modification time differs, the content hash is compared so that files
+     * that were touched but not modified are not indexed again.
+     * 
+     * @param path: The path of document file.
+     * @param info: The manifest entry of document from previous index. If document
+     * is unchanged, the modification time is updated.
+     * 
+     * @returns bool - true if document is unchanged.
+     */
+    bool checkDocumentUnchanged(const std::filesystem::path &path, DocumentInfo &info)
+    {
+        std::error_code ec;
+        uint64_t file_size = std::filesystem::file_size(path, ec);
+
+        if (ec || file_size != info.file_size)
+            return false;
+
+        int64_t modified_time = getFileModifiedTime(path);
+        if (modified_time == info.modified_time)
+            return true;
+
+        if (hashFNV1a(readFile(path)) != info.content_hash)
+            return false;
+
+        info.modified_time = modified_time;
+        return true;
+    }
+
+    /**
+     * @brief Imports unchanged documents from previous index segment.
+     * 
+     * The postings of imported documents are copied from the segment
+     * so these documents are not read or stemmed again.
+     * 
+     * @param previous: The previous index segment.
+     * @param imported: Maps document ID in previous segment to its new
+     * document ID and updated manifest entry.
+     */
+    void importDocuments(const IndexSegment &previous, std::map<int, std::pair<int, DocumentInfo>> &imported)
+    {
+        std::vector<int> new_document_ids(previous.documentCount(), -1);
+
+        for (auto &[previous_id, entry] : imported)
+        {
+            new_document_ids[previous_id] = entry.first;
+            index.documents[entry.first] = entry.second;
+        }
+
+        // Surface IDs of previous segment are mapped to IDs in new index as
+        // the words are first seen.
+        std::vector<uint32_t> surface_ids(previous.surfaceCount(), UINT32_MAX);
+
+        for (int i = 0; i < previous.termCount(); i++)
+        {
+            const SegmentTerm &term = previous.termAt(i);
+            TermPostings* term_postings = nullptr;
+
+            for (PostingCursor cursor(previous, term); !cursor.atEnd(); cursor.next())
+            {
+                int document_id = new_document_ids[cursor.document()];
+                if (document_id == -1)
+                    continue;
+
+                if (!term_postings)
+                    term_postings = &index.postings[index.getTermId(std::string(previous.termString(term)))];
+
+                SegmentPosting posting = cursor.posting();
+                for (auto &occ : previous.occurrences(term, posting))
+                {
+                    IndexedPosition position;
+                    position.line = occ.line;
+                    position.index = occ.index;
+                    position.position = occ.position;
+
+                    uint32_t &surface_id = surface_ids[occ.surface_id];
+                    if (surface_id == UINT32_MAX)
+                        surface_id = index.getSurfaceId(std::string(previous.surfaceString(occ.surface_id)));
+
+                    position.surface_id = surface_id;
+                    term_postings->positions.push_back(position);
+                }
+
+                term_postings->document_ids.push_back(document_id);
+                term_postings->occurrence_counts.push_back(posting.occurrence_count);
+            }
+        }
+    }
+
+    /**
+     * @brief Indexes the given files using a pool of indexing threads.
+     * 
+     * Each indexing thread indexes its share of documents into its own partial
+     * index so no locking is required while documents are being indexed. The
+     * partial indexes are merged once all threads finish.
+     * 
+     * Document IDs are assigned in order of the given files, regardless of
+     * which thread indexes a file, so indexes are deterministic.
+     * 
+     * If a previous index segment is given, only the files that were added or
+     * modified since it was written are indexed. The unchanged files are imported
+     * from the segment while indexing threads run.
+     * 
+     * @param files: The paths of files to index.
+     * @param previous: The previous index segment. Ignored if not open.
+     */
+    void indexFiles(const std::vector<std::filesystem::path> &files, const IndexSegment &previous)
+    {
+        std::map<std::string, int> previous_ids;
+        std::map<int, std::pair<int, DocumentInfo>> imported;
+        std::vector<size_t> pending;
+        uint64_t pending_bytes = 0;
+        int modified = 0;
+
+        for (int id = 0; id < previous.documentCount(); id++)
+            previous_ids[previous.documentPath(id).string()] = id;
+
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            auto it = previous_ids.find(files[i].string());
+            if (it == previous_ids.end())
+            {
+                pending.push_back(i);
+                pending_bytes += getFileSize(files[i]);
+                continue;
+            }
+
+            DocumentInfo info = previous.documentInfo(it->second);
+            if (checkDocumentUnchanged(files[i], info))
+                imported[it->second] = std::make_pair((int)i, info);
+            else
+            {
+                pending.push_back(i);
+                pending_bytes += getFileSize(files[i]);
+                modified++;
+            }
+        }
+
+        if (previous.isOpen())
+        {
+            log(
+                std::to_string(pending.size() - modified) + " added, "
+                + std::to_string(modified) + " modified, "
+                + std::to_string(previous.documentCount() - imported.size() - modified) + " deleted, "
+                + std::to_string(imported.size()) + " unchanged documents."
+            );
+        }
+
+        progress_files_total = pending.size();
+        progress_bytes_total = pending_bytes;
+        progress_started = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        int thread_count = indexing_threads;
+        if (thread_count <= 0)
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        if (thread_count > (int)pending.size())
+            thread_count = std::max(1, (int)pending.size());
+
+        std::vector<InvertedIndex> partial_indexes(thread_count);
+        std::vector<std::thread> threads;
+        std::atomic<size_t> next_file(0);
+
+        auto worker = [&](InvertedIndex &partial_index)
+        {
+            size_t i;
+            while ((i = next_file++) < pending.size())
+            {
+                auto &path = files[pending[i]];
+                indexDocument(path, pending[i], partial_index);
+                log(path.string() + " - DONE", "", false, 1);
+            }
+        };
+
+        for (int i = 0; i < thread_count; i++)
+            threads.emplace_back(worker, std::ref(partial_indexes[i]));
+
+        if (!imported.empty())
+            importDocuments(previous, imported);
+
+        for (auto &thread : threads)
+            thread.join();
+
+        if (!pending.empty())
+        {
+            log(
+                "Stem cache: " + std::to_string(stem_cache.getHits()) + " hits, "
+                + std::to_string(stem_cache.getMisses()) + " misses."
+            );
+        }
+
+        for (auto &partial_index : partial_indexes)
+            index.merge(partial_index);
+
+        index.sortPostings();
+    }
+
+
+    /**
+     * @brief Replaces the segment that queries are served from.
+     */
+    void setSegment(std::shared_ptr<const IndexSegment> segment)
+    {
+        auto published = std::make_shared<IndexSnapshot>();
+        published->segment = std::move(segment);
+        published->generation = ++snapshot_generation;
+
+        std::atomic_store(&snapshot, std::shared_ptr<const IndexSnapshot>(std::move(published)));
+        result_cache.setGeneration(snapshot_generation);
+    }
+
+    /**
+     * @brief Maps the given segment file and serves queries from it.
+     *
+     * @returns bool - true if segment is valid and was loaded.
+     */
+    bool loadSegment(const std::string &filename)
+    {
+        auto segment = std::make_shared<IndexSegment>();
+        if (!segment->open(filename))
+            return false;
+
+        setSegment(segment);
+        return true;
+    }
+
+    /**
+     * @brief Writes the indexes built in memory to the segment file and maps it.
+     *
+     * The segment is written to a separate file that is moved over the previous
+     * segment once complete, so the previous segment keeps serving queries while
+     * the new one is written. The in-memory indexes are released afterwards as
+     * queries are served from the segment.
+     *
+     * @returns bool - true if segment was written and loaded successfully.
+     */
+    bool writeIndex()
+    {
+        bool written = writeSegment(PENDING_INDEX_SEGMENT_FILENAME, index);
+
+        if (written && write_json_index && !writeJSONIndex())
+            log("Failed to write JSON indexes.", "WARNING");
+
+        index.clear();
+
+        if (!written)
+        {
+            log("Failed to write " + PENDING_INDEX_SEGMENT_FILENAME, "ERROR");
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(PENDING_INDEX_SEGMENT_FILENAME, INDEX_SEGMENT_FILENAME, ec);
+
+        // On Windows, a file cannot be replaced while it is mapped and the previous
+        // segment may still be in use by queries. The new segment is then served
+        // from the pending file and moved into place on next start.
+        if (ec)
+        {
+            log(INDEX_SEGMENT_FILENAME + " is in use and will be replaced on next start.", "WARNING");
+            return loadSegment(PENDING_INDEX_SEGMENT_FILENAME);
+        }
+
+        return loadSegment(INDEX_SEGMENT_FILENAME);
+    }
+
+    /**
+     * @brief Writes the in-memory indexes in JSON format of older versions of Search100.
+     * 
+     * The files are streamed one record at a time instead of being built as JSON
+     * objects in memory. term_occurrences.json is ordered by document while the
+     * posting lists are ordered by term, so the posting lists are merged by
+     * document ID and only the record of one document is held at a time.
+     * 
+     * @returns bool - true if all files were written successfully.
+     */
+    bool writeJSONIndex()
+    {
+        std::ofstream documents_fs("documents.json");
+        std::ofstream term_occurrences_fs("term_occurrences.json");
+        std::ofstream term_documents_fs("term_documents.json");
+
+        std::vector<uint32_t> term_order;
+        for (uint32_t term_id = 0; term_id < index.terms.size(); term_id++)
+        {
+            if (!index.postings[term_id].document_ids.empty())
+                term_order.push_back(term_id);
+        }
+
+        std::sort(term_order.begin(), term_order.end(), [this](uint32_t a, uint32_t b) {
+            return index.terms[a] < index.terms[b];
+        });
+
+        // Heap of (document ID, term ID) pairs for the next posting of each term.
+        std::priority_queue<std::pair<uint32_t, uint32_t>, std::vector<std::pair<uint32_t, uint32_t>>,
+                            std::greater<std::pair<uint32_t, uint32_t>>> next_postings;
+        std::vector<uint32_t> posting_indexes(index.terms.size(), 0);
+        std::vector<uint64_t> position_indexes(index.terms.size(), 0);
+
+        for (uint32_t term_id : term_order)
+            next_postings.emplace(index.postings[term_id].document_ids[0], term_id);
+
+        documents_fs << '{';
+        term_occurrences_fs << '{';
+
+        for (auto &[document_id, info] : index.documents)
+        {
+            nlohmann::json doc_term_occurrences = nlohmann::json::object();
+
+            while (!next_postings.empty() && (int)next_postings.top().first == document_id)
+            {
+                uint32_t term_id = next_postings.top().second;
+                const TermPostings &term_postings = index.postings[term_id];
+                uint32_t &posting_index = posting_indexes[term_id];
+                uint64_t &position_index = position_indexes[term_id];
+                next_postings.pop();
+
+                auto &occurrences = doc_term_occurrences[index.terms[term_id]] = nlohmann::json::array();
+                for (uint32_t i = 0; i < term_postings.occurrence_counts[posting_index]; i++)
+                {
+                    const IndexedPosition &position = term_postings.positions[position_index++];
+                    occurrences.push_back({
+                        {"line", position.line},
+                        {"index", position.index},
+                        {"original", index.surfaces[position.surface_id]},
+                    });
+                }
+
+                if (++posting_index < term_postings.document_ids.size())
+                    next_postings.emplace(term_postings.document_ids[posting_index], term_id);
+            }
+
+            const char* separator = (document_id == index.documents.begin()->first) ? "" : ",";
+            documents_fs << separator << nlohmann::json(info.path.string()) << ':' << document_id;
+            term_occurrences_fs << separator << '"' << document_id << "\":" << doc_term_occurrences;
+        }
+
+        term_documents_fs << '{';
+        for (uint32_t term_id : term_order)
+        {
+            const char* separator = (term_id == term_order.front()) ? "" : ",";
+            term_documents_fs << separator << nlohmann::json(index.terms[term_id]) << ':'
+                              << nlohmann::json(index.postings[term_id].document_ids);
+        }
+
+        documents_fs << '}' << std::endl;
+        term_occurrences_fs << '}' << std::endl;
+        term_documents_fs << '}' << std::endl;
+
+        documents_fs.close();
+        term_occurrences_fs.close();
+        term_documents_fs.close();
+
+        return !(documents_fs.fail() || term_occurrences_fs.fail() || term_documents_fs.fail());
+    }
+
+    /**
+     * @brief Reads the given JSON file.
+     * 
+     * @param filename: The name of file to read from.
+     * 
+     * @returns `nlohmann::json` - the parsed JSON.
+     */
+    nlohmann::json readJSON(const std::string filename)
+    {
+        std::ifstream fs(filename);
+        return nlohmann::json::parse(fs);
+    }
+
+    /**
+     * @brief Gets the thread pool that queries are scored on, creating it on first use
+     * with `query_threads` threads.
+     */
+    ThreadPool &getQueryPool() const
+    {
+        std::call_once(query_pool_created, [this]() {
+            int thread_count = query_threads;
+            if (thread_count <= 0)
+                thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+            // The thread running the query is one of the threads scoring it.
+            query_pool = std::make_unique<ThreadPool>(thread_count - 1);
+        });
+
+        return *query_pool;
+    }
+
+    /**
+     * @brief Looks up the searched terms in term dictionary.
+     * 
+     * @param segment: The segment to look up terms in.
+     * @param query_terms: The searched terms.
+     * 
+     * @returns vector<const SegmentTerm*> - the term entries in order of searched
+     * terms. Terms that are not indexed are nullptr. A term that is searched more
+     * than once is only included once.
+     */
+    std::vector<const SegmentTerm*> lookupTerms(const IndexSegment &segment, const std::vector<Stem> &query_terms) const
+    {
+        std::vector<const SegmentTerm*> entries;
+        entries.reserve(query_terms.size());
+
+        for (auto &term : query_terms)
+        {
+            const SegmentTerm* entry = segment.findTerm(term.stemmed);
+            if (!entry || std::find(entries.begin(), entries.end(), entry) == entries.end())
+                entries.push_back(entry);
+        }
+
+        return entries;
+    }
+
+    /**
+     * @brief Finds the common documents in which all searched terms occur.
+     * 
+     * This method is used when searching is performed using 'AND' strategy, that
+     * is, only documents that have all of the searched terms are returned.
+     * 
+     * Terms are intersected in ascending order of document frequency so that the
+     * rarest term proposes candidate documents. If the two rarest terms have posting
+     * lists of similar size, their decoded blocks are intersected with intersectSorted();
+     * otherwise each cursor is advanced to the largest document seen so far until all
+     * cursors agree on a document. Either way, the remaining terms are only probed for
+     * candidates by galloping through their posting blocks, and blocks that cannot
+     * contain a candidate are skipped without being decoded.
+     * 
+     * @param segment: The segment that terms were read from.
+     * @param query_terms: The term entries of searched terms.
+     * 
+     * @returns vector<int> - the document IDs in ascending order.
+     */
+    std::vector<int> findCommonDocuments(const IndexSegment &segment, const std::vector<const SegmentTerm*> &query_terms) const
+    {
+        std::vector<int> common_document_ids;
+        std::vector<const SegmentTerm*> terms;
+
+        for (const SegmentTerm* entry : query_terms)
+        {
+            // A term that does not occur in any document leaves no common documents.
+            if (!entry)
+                return common_document_ids;
+
+            terms.push_back(entry);
+        }
+
+        if (terms.empty())
+            return common_document_ids;
+
+        std::stable_sort(terms.begin(), terms.end(), [](const SegmentTerm* a, const SegmentTerm* b) {
+            return a->document_frequency < b->document_frequency;
+        });
+
+        std::vector<PostingCursor> cursors;
+        cursors.reserve(terms.size());
+
+        for (const SegmentTerm* entry : terms)
+            cursors.emplace_back(segment, *entry);
+
+        // Checks whether a candidate occurs in all terms after the first `start` ones. If
+        // not, candidate is set to the document that the first mismatching cursor is at.
+        // Returns false when some cursor is exhausted and no more documents can match.
+        auto probe = [&cursors](size_t start, uint32_t &candidate, bool &matched)
+        {
+            matched = true;
+            for (size_t i = start; i < cursors.size(); i++)
+            {
+                if (!cursors[i].advance(candidate))
+                    return false;
+
+                if (cursors[i].document() != candidate)
+                {
+                    candidate = cursors[i].document();
+                    matched = false;
+                    break;
+                }
+            }
+
+            return true;
+        };
+
+        if (cursors.size() > 1 && terms[1]->document_frequency / terms[0]->document_frequency < GALLOPING_INTERSECTION_RATIO)
+        {
+            PostingCursor &a = cursors[0];
+            PostingCursor &b = cursors[1];
+            uint32_t matches[POSTING_BLOCK_SIZE];
+
+            while (!a.atEnd() && !b.atEnd())
+            {
+                uint32_t a_count, b_count;
+                const uint32_t* a_documents = a.blockDocuments(a_count);
+                const uint32_t* b_documents = b.blockDocuments(b_count);
+
+                size_t match_count = intersectSorted(a_documents, a_count, b_documents, b_count, matches);
+                uint32_t a_last = a_documents[a_count - 1];
+                uint32_t b_last = b_documents[b_count - 1];
+
+                for (size_t i = 0; i < match_count; i++)
+                {
+                    uint32_t candidate = matches[i];
+                    bool matched;
+
+                    if (!probe(2, candidate, matched))
+                        return common_document_ids;
+
+                    if (matched)
+                        common_document_ids.push_back(candidate);
+                }
+
+                // The block that ends first is done; the other one continues past it.
+                if (a_last < b_last)
+                {
+                    a.nextBlock();
+                    b.advance(a_last + 1);
+                }
+                else if (b_last < a_last)
+                {
+                    b.nextBlock();
+                    a.advance(b_last + 1);
+                }
+                else
+                {
+                    a.nextBlock();
+                    b.nextBlock();
+                }
+            }
+
+            return common_document_ids;
+        }
+
+        uint32_t candidate = 0;
+
+        while (true)
+        {
+            bool matched;
+            if (!probe(0, candidate, matched))
+                return common_document_ids;
+
+            if (matched)
+                common_document_ids.push_back(candidate++);
+        }
+    }
+
+    /**
+     * @brief Compares relevance scores returned by getRelevantScores().
+     * 
+     * Scores are ordered in descending order; equal scores are ordered by document
+     * ID so that results do not depend on order they were scored in.
+     * 
+     * @returns bool - true if `a` is ranked above `b`.
+     */
+    static bool rankedAbove(const std::pair<int, double> &a, const std::pair<int, double> &b)
+    {
+        if (a.second != b.second)
+            return a.second > b.second;
+
+        return a.first < b.first;
+    }
 
-        documents[document_id] = path;
-        term_occurrences[document_id] = {};
+    /**
+     * @brief Gets relevance scores for each document in which the searched terms occur.
+     * 
+     * If `search_strategy_and` is true, only the documents in which all searched terms
+     * occur are returned. In contrary case, the documents that have any of searched terms
+     * are returned.
+     * 
+     * Documents are scored one at a time: the posting lists of all terms are iterated
+     * together and the relevance score of a document is the sum of scores of searched
+     * terms that occur in it, as computed by the scorer (see scoring.cpp).
+     * 
+     * If `max_results` is non-zero, only that many highest ranked scores are returned.
+     * These are kept in a bounded heap and, once the heap is full, its lowest score is
+     * a threshold that other documents must reach. With 'OR' strategy, documents are
+     * skipped using WAND: the scorer bounds the score of each term in any document,
+     * so documents that only contain terms whose bounds add up to less than the
+     * threshold are skipped without being scored. The same check is repeated with
+     * the bounds of posting blocks.
+     * 
+     * OR queries with many postings are scored in parallel on the query thread pool:
+     * the document IDs are split into ranges with about as many postings each, every
+     * range is scored into its own heap, and the heaps are merged. Each range keeps
+     * the highest ranked scores in it so the merged scores are the same as if all
+     * documents were scored on one thread.
+     * 
+     * @param segment: The segment that terms were read from.
+     * @param scorer: The scorer to compute scores with.
+     * @param query_terms: The term entries of searched terms, as returned by lookupTerms().
+     * @param search_strategy_and: Whether to use 'AND' strategy. If false, uses 'OR' strategy.
+     * @param max_results: The maximum number of scores to return. If zero, all are returned.
+     * @param matches: If not nullptr, only the documents it iterates over are scored
+     * regardless of strategy, e.g. the ones matched by a query with operators.
+     * @param after: If not nullptr, only the scores ranked below it (see rankedAbove())
+     * are returned, e.g. the ones after the last result of previous page.
+     * @param first_document: With 'OR' strategy, only documents with IDs in range
+     * [first_document, end_document) are scored.
+     * @param end_document: See `first_document`.
+     * 
+     * @returns vector<pair<int, double>> - vector of pairs of document ID and relevance score,
+     * in descending order of score.
+     */
+    template <typename Scorer>
+    std::vector<std::pair<int, double>> getRelevantScores(const IndexSegment &segment,
+                                                          const Scorer &scorer,
+                                                          const std::vector<const SegmentTerm*> &query_terms,
+                                                          bool search_strategy_and = true,
+                                                          size_t max_results = 0,
+                                                          DocumentIterator* matches = nullptr,
+                                                          const std::pair<int, double>* after = nullptr,
+                                                          uint32_t first_document = 0,
+                                                          uint32_t end_document = UINT32_MAX) const
+    {
+        std::vector<std::pair<int, double>> relevance_scores;
+
+        if (!search_strategy_and && !matches && first_document == 0 && end_document == UINT32_MAX)
+        {
+            const SegmentTerm* largest = nullptr;
+            uint64_t posting_count = 0;
+
+            for (const SegmentTerm* entry : query_terms)
+            {
+                if (!entry)
+                    continue;
+
+                posting_count += entry->document_frequency;
+                if (!largest || entry->document_frequency > largest->document_frequency)
+                    largest = entry;
+            }
+
+            size_t range_count = 0;
+            if (posting_count >= 2 * PARALLEL_SCORING_POSTINGS)
+                range_count = std::min<uint64_t>(posting_count / PARALLEL_SCORING_POSTINGS, getQueryPool().size());
+
+            if (range_count > 1)
+            {
+                // Ranges start at posting blocks of the most frequent term, spread evenly
+                // over its blocks, so that each range has a similar number of postings.
+                const SegmentPostingBlock* blocks = segment.termBlocks(*largest);
+                uint32_t block_count = segment.termBlockCount(*largest);
+                std::vector<uint32_t> bounds{0};
+
+                for (size_t i = 1; i < range_count; i++)
+                {
+                    uint32_t bound = blocks[i * block_count / range_count].first_document_id;
+                    if (bound > bounds.back())
+                        bounds.push_back(bound);
+                }
+
+                // The postings may all be in documents below the first bound, leaving a
+                // single range that is scored on this thread below.
+                bounds.push_back(UINT32_MAX);
+                if (bounds.size() > 2)
+                {
+                    std::vector<std::vector<std::pair<int, double>>> partial_scores(bounds.size() - 1);
+
+                    getQueryPool().run(partial_scores.size(), [&](size_t i) {
+                        partial_scores[i] = getRelevantScores(segment, scorer, query_terms, false, max_results,
+                                                              nullptr, after, bounds[i], bounds[i + 1]);
+                    });
+
+                    for (auto &scores : partial_scores)
+                        relevance_scores.insert(relevance_scores.end(), scores.begin(), scores.end());
+
+                    std::sort(relevance_scores.begin(), relevance_scores.end(), rankedAbove);
+                    if (max_results && relevance_scores.size() > max_results)
+                        relevance_scores.resize(max_results);
+
+                    return relevance_scores;
+                }
+            }
+        }
+
+        // With a limit, relevance_scores is a heap with lowest ranked score at front.
+        auto isFull = [&]()
+        {
+            return max_results && relevance_scores.size() >= max_results;
+        };
+
+        // Bounds are summed in a different order than scores are, so a small margin
+        // keeps rounding errors from pruning a document that would tie the threshold.
+        auto canReachThreshold = [&](double bound)
+        {
+            return !isFull() || bound * (1 + 1e-9) >= relevance_scores.front().second;
+        };
+
+        auto addScore = [&](int document_id, double score)
+        {
+            std::pair<int, double> entry(document_id, score);
+
+            if (after && !rankedAbove(*after, entry))
+                return;
+
+            if (!max_results)
+            {
+                relevance_scores.push_back(entry);
+            }
+            else if (!isFull())
+            {
+                relevance_scores.push_back(entry);
+                std::push_heap(relevance_scores.begin(), relevance_scores.end(), rankedAbove);
+            }
+            else if (rankedAbove(entry, relevance_scores.front()))
+            {
+                std::pop_heap(relevance_scores.begin(), relevance_scores.end(), rankedAbove);
+                relevance_scores.back() = entry;
+                std::push_heap(relevance_scores.begin(), relevance_scores.end(), rankedAbove);
+            }
+        };
+
+        struct TermCursor
+        {
+            const SegmentTerm* entry;
+            PostingCursor cursor;
+            double weight;
+            double max_score;
+        };
+
+        std::vector<TermCursor> cursors;
+        std::vector<int> common_document_ids;
+        bool and_strategy = search_strategy_and && !matches;
+
+        if (and_strategy)
+        {
+            common_document_ids = findCommonDocuments(segment, query_terms);
+            if (common_document_ids.empty())
+                return relevance_scores;
+        }
+
+        if (matches && matches->atEnd())
+            return relevance_scores;
+
+        cursors.reserve(query_terms.size());
+        for (const SegmentTerm* entry : query_terms)
+        {
+            if (!entry)
+                continue;
+
+            double weight = scorer.termWeight(*entry);
+            cursors.push_back(TermCursor{entry, PostingCursor(segment, *entry), weight, scorer.maxScore(weight, *entry)});
+
+            if (first_document > 0)
+                cursors.back().cursor.advance(first_document);
+        }
 
-        documents_json[path.string()] = document_id;
-        term_occurrences_json[document_id_str] = std::map<std::string, std::vector<nlohmann::json>>();
-        auto &doc_term_occurrences = term_occurrences_json[document_id_str];
+        auto scoreDocument = [&](int document_id)
+        {
+            double score = 0;
+            for (auto &term : cursors)
+            {
+                if (term.cursor.advance(document_id) && (int)term.cursor.document() == document_id)
+                    score += scorer.score(term.weight, term.cursor.posting());
+            }
+
+            addScore(document_id, score);
+        };
+
+        if (and_strategy)
+        {
+            for (int document_id : common_document_ids)
+                scoreDocument(document_id);
+        }
+        else if (matches)
+        {
+            for (; !matches->atEnd(); matches->next())
+                scoreDocument(matches->document());
+        }
+        else
+        {
+            // Cursors that are not at end, sorted by their current document.
+            std::vector<TermCursor*> active;
+            for (auto &term : cursors)
+                active.push_back(&term);
+
+            while (true)
+            {
+                active.erase(std::remove_if(active.begin(), active.end(), [end_document](TermCursor* term) {
+                    return term->cursor.atEnd() || term->cursor.document() >= end_document;
+                }), active.end());
+
+                if (active.empty())
+                    break;
+
+                std::sort(active.begin(), active.end(), [](TermCursor* a, TermCursor* b) {
+                    return a->cursor.document() < b->cursor.document();
+                });
+
+                // The pivot is the first cursor whose term, together with terms before
+                // it, can reach the threshold. Documents before the pivot's document
+                // only contain the terms before it so these cannot reach the threshold.
+                size_t pivot = 0;
+                double bound = active[0]->max_score;
+
+                while (!canReachThreshold(bound) && ++pivot < active.size())
+                    bound += active[pivot]->max_score;
+
+                if (pivot == active.size())
+                    break;
+
+                uint32_t pivot_document = active[pivot]->cursor.document();
+
+                if (active[0]->cursor.document() != pivot_document)
+                {
+                    for (size_t i = 0; i < pivot; i++)
+                        active[i]->cursor.advance(pivot_document);
+
+                    continue;
+                }
+
+                double block_bound = 0;
+                for (TermCursor* term : active)
+                {
+                    if (term->cursor.document() == pivot_document)
+                        block_bound += scorer.maxScore(term->weight, term->cursor.currentBlock());
+                }
+
+                // Scores are summed in order of searched terms so they do not depend
+                // on order of cursors.
+                bool prunable = !canReachThreshold(block_bound);
+                double score = 0;
+
+                for (auto &term : cursors)
+                {
+                    if (term.cursor.atEnd() || term.cursor.document() != pivot_document)
+                        continue;
+
+                    if (!prunable)
+                        score += scorer.score(term.weight, term.cursor.posting());
+
+                    term.cursor.next();
+                }
+
+                if (!prunable)
+                    addScore(pivot_document, score);
+            }
+        }
+
+        if (max_results)
+            std::sort_heap(relevance_scores.begin(), relevance_scores.end(), rankedAbove);
+        else
+            std::sort(relevance_scores.begin(), relevance_scores.end(), rankedAbove);
+
+        return relevance_scores;
+    }
+
+    /**
+     * @brief Runs a prepared query. See search().
+     * 
+     * @param prepared: The prepared query. Its query must not be empty.
+     * @param max_results: The maximum number of results to return. If zero, all are returned.
+     * @param after: If not nullptr, only results ranked below this pair of document ID
+     * and relevance score are returned.
+     * 
+     * @returns vector<SearchResult> - the search results in descending order of relevance.
+     */
+    std::vector<SearchResult> executeQuery(const PreparedQuery &prepared, size_t max_results,
+                                           const std::pair<int, double>* after) const
+    {
+        const std::shared_ptr<const IndexSegment> &segment = prepared.segment;
+        const QueryNode &parsed = prepared.query;
+        std::vector<SearchResult> results;
+        auto entries = lookupTerms(*segment, parsed.searchedTerms());
+        std::vector<std::pair<int, double>> relevance_scores;
+
+        // Words joined by a single operator are matched by the scoring loop itself;
+        // other queries are matched by iterating over the query tree.
+        QueryOperator flat_operator;
+        std::unique_ptr<DocumentIterator> matches;
+        bool search_strategy_and = true;
+
+        if (parsed.isFlat(flat_operator))
+        {
+            search_strategy_and = (flat_operator != QueryOperator::OR);
+        }
+        else
+        {
+            matches = buildIterator(*segment, parsed);
+            if (!matches)
+                return results;
+        }
+
+        if (prepared.ranking == RankingFunction::BM25)
+        {
+            BM25Scorer scorer(*segment, prepared.bm25_k1, prepared.bm25_b);
+            relevance_scores = getRelevantScores(*segment, scorer, entries, search_strategy_and, max_results, matches.get(), after);
+        }
+        else
+        {
+            TfIdfScorer scorer(*segment);
+            relevance_scores = getRelevantScores(*segment, scorer, entries, search_strategy_and, max_results, matches.get(), after);
+        }
+
+        results.reserve(relevance_scores.size());
+
+        for (auto &[document_id, score] : relevance_scores)
+        {
+            SearchResult result;
+            result.document_id = document_id;
+            result.relevance_score = score;
+            result.segment = segment;
 
-        while (getline(fs, line))
-        {
-            std::vector<Stem> stems = stemmer.stemLine(line);
-            for (Stem stem : stems)
+            for (const SegmentTerm* entry : entries)
             {
-                Occurrence occ = Occurrence::fromStem(stem, document_id, lineno);
-                term_occurrences[document_id][stem.stemmed].push_back(occ);
-                term_documents[stem.stemmed].insert(document_id);
-
-                if (!doc_term_occurrences.count(stem.stemmed))
-                    doc_term_occurrences[stem.stemmed] = std::vector<nlohmann::json>{};
+                SegmentPosting posting;
+                if (!entry || !segment->findPosting(*entry, document_id, posting))
+                    continue;
 
-                doc_term_occurrences[stem.stemmed].push_back(occ.toJSON());
-                term_documents_json[stem.stemmed] = term_documents[stem.stemmed];
+                result.term_ids.push_back(segment->termId(*entry));
+                result.postings.push_back(posting);
             }
-            lineno++;
-        }
-    }
 
+            results.push_back(std::move(result));
+        }
 
-    /**
-     * @brief Writes the given JSON object to file at given path.
-     * 
-     * @param filename: The name of file to write into.
-     * @param obj: The JSON object to write.
-     * 
-     * @returns `nlohmann::json` - the parsed JSON.
-     */
-    void writeJSON(const std::string filename, const nlohmann::json &obj)
-    {
-        std::ofstream fs(filename);
-        fs << obj << std::endl;
-        fs.close();
+        return results;
     }
 
     /**
-     * @brief Reads the given JSON file.
+     * @brief Parses a query and takes the current segment to run it on.
      * 
-     * @param filename: The name of file to read from.
+     * @param query: The search query as string.
+     * @param search_strategy_and: Whether words are joined by AND by default.
+     * @param ranking: The ranking function that results are ranked by.
+     * @param prepared: Set to the prepared query.
      * 
-     * @returns `nlohmann::json` - the parsed JSON.
+     * @returns bool - false if query has no words to search or nothing is indexed.
      */
-    nlohmann::json readJSON(const std::string filename)
+    bool prepareQuery(const std::string &query, bool search_strategy_and, RankingFunction ranking, PreparedQuery &prepared) const
     {
-        std::ifstream fs(filename);
-        return nlohmann::json::parse(fs);
-    }
+        PorterStemmer stemmer(&stem_cache);
+        prepared.query = parseQuery(query, stemmer, search_strategy_and);
 
-    /**
-     * @brief Computes the term frequency (TF) of a term in a document.
-     * 
-     * TF(t, d) = (number of times t occurs in d) / (total number of terms in d)
-     * 
-     * t: the targeted term
-     * d: the targeted document
-     * 
-     * TF is the measure of how frequent a term occurs in a document. The
-     * value ranges between 0-1 with higher values indicating higher frequency.
-     * 
-     * https://en.wikipedia.org/wiki/Tf%E2%80%93idf#Term_frequency
-     * 
-     * @param term: The stemmed term to find TF for.
-     * @param document_id: The ID of document to find TF of term in.
-     * 
-     * @returns double - TF value.
-     */
-    double computeTF(std::string term, int document_id)
-    {
-        double term_freq = (double)(term_occurrences[document_id][term].size());
-        double total_terms = (double)(term_occurrences[document_id].size());
+        if (prepared.query.empty())
+        {
+            log("Terms are not enough for query.");
+            return false;
+        }
+
+        auto current = getSnapshot();
+        prepared.segment = current->segment;
+        prepared.generation = current->generation;
+        prepared.ranking = ranking;
+        prepared.bm25_k1 = bm25_k1;
+        prepared.bm25_b = bm25_b;
 
-        return term_freq / total_terms;
+        return prepared.segment != nullptr;
     }
 
     /**
-     * @brief Computes the inverse document frequency (IDF) value for given term.
-     * 
-     * IDF(t) = (number of documents in corpus) / (number of documents containing t)
-     * 
-     * t: the targeted term
+     * @brief Runs a prepared query, reading results from cache if possible.
      * 
-     * IDF is measure of how rare the term is in corpus documents. Higher IDF value
-     * for a term indicates that the term is rare and lower value indicates less rare
-     * or common terms.
-     * 
-     * https://en.wikipedia.org/wiki/Tf%E2%80%93idf#Inverse_document_frequency
-     * 
-     * @param term: The stemmed term to find IDF for.
-     * 
-     * @returns double - IDF value.
+     * See executeQuery() for parameters.
      */
-    double computeIDF(std::string term)
+    std::vector<SearchResult> runQuery(const PreparedQuery &prepared, size_t max_results, const std::pair<int, double>* after) const
     {
-        double total_docs = (double)documents.size();
-        double df = (double)term_documents[term].size();
+        // Words joined by default operator are already resolved to AND or OR in the
+        // normalized query, so strategy does not need to be part of key. Generation
+        // is, as cursors may still read from a segment that was replaced.
+        std::ostringstream key;
+        key << prepared.generation << '\n' << prepared.query.normalized() << '\n' << max_results << '\n';
+
+        if (prepared.ranking == RankingFunction::BM25)
+            key << "BM25 " << std::hexfloat << prepared.bm25_k1 << " " << prepared.bm25_b;
+        else
+            key << "TF-IDF";
 
-        // This function has an initial requirement that there must
-        // be at least one document in which the term appears otherwise
-        // zero-division error is encountered. getRelevanceScore() method
-        // only calls this function if there are documents in which term exist.
-        return std::log(total_docs / df);
+        if (after)
+            key << '\n' << after->first << " " << std::hexfloat << after->second;
+
+        if (auto cached = result_cache.find(key.str()))
+            return *cached;
+
+        auto results = std::make_shared<std::vector<SearchResult>>(executeQuery(prepared, max_results, after));
+        size_t size = sizeof(*results);
+
+        for (auto &result : *results)
+        {
+            size += sizeof(result) + result.term_ids.capacity() * sizeof(uint32_t)
+                    + result.postings.capacity() * sizeof(SegmentPosting);
+        }
+
+        result_cache.insert(key.str(), prepared.generation, results, size);
+        return *results;
     }
 
     /**
-     * @brief Computes the TF-IDF value for given term in given document.
-     * 
-     * TF-IDF is measure for how relevant a term is in a document. That is,
-     * terms with higher TF-IDF values are ranked higher in search results
-     * as such terms are more relevant. TF-IDF is therefore referred to as
-     * relevance or importance score.
-     * 
-     * https://en.wikipedia.org/wiki/Tf%E2%80%93idf#Term_frequency%E2%80%93inverse_document_frequency
+     * @brief Fetches the results of a page after the position of its cursor, and
+     * moves the cursor past them.
      * 
-     * @param term: The stemmed term to find IDF for.
-     * @param document_id: The ID of document to find IDF of term in.
-     * 
-     * @returns double - TF-IDF value.
+     * @param page: The page to fill.
+     * @param first: Whether this is the first page of search.
      */
-    double computeTfIdf(std::string term, int document_id)
+    void fillPage(SearchPage &page, bool first) const
     {
-        double tf = computeTF(term, document_id);
-        double idf = computeIDF(term);
+        SearchCursor &cursor = page.cursor;
+
+        // One more result than fits in page is fetched to tell if there are more pages.
+        page.results = runQuery(cursor.prepared, cursor.page_size + 1, first ? nullptr : &cursor.last);
+        cursor.has_more = page.results.size() > cursor.page_size;
 
-        return (idf * tf);
+        if (cursor.has_more)
+            page.results.pop_back();
+
+        if (!page.results.empty())
+            cursor.last = std::make_pair(page.results.back().document_id, page.results.back().relevance_score);
     }
 
     /**
-     * @brief Finds the common documents in which all searched terms occur.
-     * 
-     * This method is used when searching is performed using 'AND' strategy, that
-     * is, only documents that have all of the searched terms are returned.
-     * 
-     * @param query_terms: The searched terms.
+     * @brief Indexes the documents in corpus directory, see indexCorpusDirectory().
      * 
-     * @returns set<int> - the document IDs.
+     * The caller must have claimed the `indexing` flag.
      */
-    std::set<int> findCommonDocuments(std::vector<Stem> &query_terms)
+    void runIndexing(bool useData)
     {
-        std::set<int> common_document_ids;
-        std::set<int> inserter_set;
+        index.clear();
+        progress_files_done = 0;
+        progress_files_total = 0;
+        progress_bytes_done = 0;
+        progress_bytes_total = 0;
 
-        for (auto &term : query_terms)
+        log("Finding local documents index...");
+
+        // A segment that could not replace the previous one while it was
+        // mapped is moved into place once nothing is mapped.
+        if (!getSegment() && checkFileExists(PENDING_INDEX_SEGMENT_FILENAME))
         {
-            auto &term_document_ids = term_documents[term.stemmed];
+            IndexSegment pending;
+            bool valid = pending.open(PENDING_INDEX_SEGMENT_FILENAME);
+            pending.close();
 
-            if (common_document_ids.empty())
-            {
-                std::set_union(
-                    common_document_ids.begin(),
-                    common_document_ids.end(),
-                    term_document_ids.begin(),
-                    term_document_ids.end(),
-                    std::inserter(inserter_set, inserter_set.begin())
-                );
-            }
+            std::error_code ec;
+            if (valid)
+                std::filesystem::rename(PENDING_INDEX_SEGMENT_FILENAME, INDEX_SEGMENT_FILENAME, ec);
             else
+                std::filesystem::remove(PENDING_INDEX_SEGMENT_FILENAME, ec);
+        }
+
+        if (useData && checkFileExists(INDEX_SEGMENT_FILENAME))
+        {
+            log("Loading local indexes...");
+
+            if (loadSegment(INDEX_SEGMENT_FILENAME))
             {
-                std::set_intersection(
-                    common_document_ids.begin(),
-                    common_document_ids.end(),
-                    term_document_ids.begin(),
-                    term_document_ids.end(),
-                    std::inserter(inserter_set, inserter_set.begin())
-                );
+                log("Successfully loaded indexes for " + std::to_string(getIndexSize()) + " documents.");
+                return;
             }
 
-            common_document_ids = inserter_set;
-            inserter_set.clear();
+            log("Local indexes are incompatible or corrupted.", "WARNING");
         }
+        else if (useData && checkFileExists("term_occurrences.json") && checkFileExists("term_documents.json")
+                 && checkFileExists("documents.json"))
+        {
+            log("Migrating local JSON indexes to " + INDEX_SEGMENT_FILENAME + "...");
+            loadFromFiles();
 
-        return common_document_ids;
-    }
+            if (writeIndex())
+            {
+                log("Successfully loaded indexes for " + std::to_string(getIndexSize()) + " documents.");
+                return;
+            }
+        }
 
-    /**
-     * @brief Gets relevance scores for each document in which the searched term occurs.
-     * 
-     * If `search_strategy_and` is true, only the documents in which all searched terms
-     * occur are returned. In contrary case, the documents that have any of searched terms
-     * are returned.
-     * 
-     * @param query_terms: Vector of searched terms.
-     * @param search_strategy_and: Whether to use 'AND' strategy. If false, uses 'OR' strategy.
-     * 
-     * @returns vector<tuple<Stem, int, double>> - vector of 3-tuples each value representing
-     * searched term, its document ID, and relevance score respectively.
-     */
-    std::vector<std::tuple<Stem, int, double>> getRelevantScores(std::vector<Stem> &query_terms, bool search_strategy_and = true)
-    {
-        std::vector<std::tuple<Stem, int, double>> relevance_scores;
-        std::set<int> document_ids;
+        // The current segment keeps serving queries while documents are reindexed.
+        std::shared_ptr<const IndexSegment> previous = getSegment();
+        if (!previous || !incremental_indexing || useData)
+            previous = std::make_shared<IndexSegment>();
 
-        if (search_strategy_and)
-            document_ids = findCommonDocuments(query_terms);
+        if (previous->isOpen())
+            log("Reindexing changed documents in corpus directory...");
+        else
+        {
+            log("No local indexes found.");
+            log("Indexing corpus directory...");
+        }
 
-        for (auto &term : query_terms)
+        std::vector<std::filesystem::path> files;
+
+        for (auto &file : std::filesystem::recursive_directory_iterator(corpus_directory_path))
         {
-            if (!search_strategy_and)
-                document_ids = term_documents[term.stemmed];
+            std::filesystem::path fp = file.path();
+            if (fp.extension().string() != ".txt")
+                continue;
 
-            for (int document_id : document_ids)
-            {
-                auto tup = std::make_tuple(term, document_id, computeTfIdf(term.stemmed, document_id));
-                relevance_scores.push_back(tup);
-            }
+            files.push_back(fp);
         }
 
-        std::sort(
-            relevance_scores.begin(),
-            relevance_scores.end(),
-            [](const std::tuple<Stem, int, double> &a, std::tuple<Stem, int, double> &b)
-            {
-                return std::get<2>(a) > std::get<2>(b);
-            }
-        );
+        indexFiles(files, *previous);
+        previous.reset();
 
-        return relevance_scores;
+        if (index.documents.empty())
+        {
+            setSegment(nullptr);
+            log(
+                "No searchable text documents. Place text files to be searched in "
+                + corpus_directory_path.string() + " directory and restart Search100!",
+                "WARNING"
+            );
+            return;
+        }
+
+        log("Writing index data to disk...");
+        if (writeIndex())
+            log("Successfully indexed " + std::to_string(getIndexSize()) + " documents...");
     }
 
     public:
@@ -356,6 +1536,40 @@ class SearchEngine
     /* The path pointing to directory containing the documents (or text files) to be searched. */
     std::filesystem::path corpus_directory_path;
 
+    /* The number of threads used for indexing. If zero, one thread per hardware core is used. */
+    int indexing_threads = 0;
+
+    /**
+     * @brief The number of threads that a single large query may be scored on. If zero,
+     * one thread per hardware core is used. Only read when the first large query is run.
+     */
+    int query_threads = 0;
+
+    /**
+     * @brief Whether reindexing only indexes the documents that changed.
+     * 
+     * If true, reindexing reuses the previous index for documents whose size,
+     * modification time or content did not change. If false, all documents are
+     * indexed again.
+     */
+    bool incremental_indexing = true;
+
+    /**
+     * @brief Whether indexes are also written in JSON format of older versions of Search100.
+     * 
+     * The JSON files are only written for compatibility; they are much larger
+     * and slower to load than the index segment.
+     */
+    bool write_json_index = false;
+
+    /**
+     * @brief The term frequency saturation (k1) and document length normalization (b)
+     * parameters of BM25 ranking. See BM25Scorer. These are read by queries so they
+     * must not be changed while queries are running.
+     */
+    double bm25_k1 = 1.2;
+    double bm25_b = 0.75;
+
     /**
      * @brief Search engine constructor
      * 
@@ -368,69 +1582,145 @@ class SearchEngine
             throw "corpus_directory_path_str must be a directory, not a file.";
     }
 
+    /**
+     * @brief Waits for background indexing to finish.
+     */
+    ~SearchEngine()
+    {
+        std::lock_guard<std::mutex> lock(indexing_thread_mutex);
+        if (indexing_thread.joinable())
+            indexing_thread.join();
+    }
+
     /**
      * @brief Index the documents in corpus directory.
      * 
      * This method will first check whether local data of indexes is
-     * available. If so, the data will be loaded. In case data is not
-     * available, the files are indexed and indexes are stored locally.
+     * available. If so, the index segment is memory mapped and queries
+     * are served from it directly. In case data is not available, the
+     * files are indexed and the index segment is written locally.
      * 
      * @param useData: If true (default), the local indexes data is used
      * to load indexes in memory if available. If false, even if data is
-     * available, the indexes are regenerated from corpus.
+     * available, the indexes are regenerated from corpus. Unless
+     * `incremental_indexing` is disabled, only the documents that were
+     * added or modified since indexes were written are indexed again.
+     * 
+     * Blocks until indexing finishes. Throws if documents are already being
+     * indexed, e.g. by startIndexing().
      * 
      */
     void indexCorpusDirectory(bool useData = true)
     {
-        doc_id_tracker = -1;
-        documents.clear();
-        term_documents.clear();
-        term_occurrences.clear();
+        bool expected = false;
+        if (!indexing.compare_exchange_strong(expected, true))
+            throw "Documents are already being indexed.";
 
-        log("Finding local documents index...");
-
-        if (checkFileExists("term_occurrences.json") && checkFileExists("term_documents.json")
-            && checkFileExists("documents.json") && useData)
+        try
         {
-            log("Loading local indexes...");
-            loadFromFiles();
-
-            log("Successfully loaded indexes for " + std::to_string(getIndexSize()) + " documents.");
-            return;
+            runIndexing(useData);
+        }
+        catch (...)
+        {
+            indexing = false;
+            throw;
         }
 
-        log("No local indexes found.");
-        log("Indexing corpus directory...");
+        indexing = false;
+    }
 
-        nlohmann::json documents_json;
-        nlohmann::json term_occurrences_json;
-        nlohmann::json term_documents_json;
+    /**
+     * @brief Indexes the documents in corpus directory on a background thread.
+     * 
+     * Queries are served from the current indexes until indexing finishes and
+     * the new indexes replace them. See indexCorpusDirectory() for details.
+     * 
+     * @param useData: Same as in indexCorpusDirectory().
+     * 
+     * @returns bool - false if documents are already being indexed.
+     */
+    bool startIndexing(bool useData = true)
+    {
+        bool expected = false;
+        if (!indexing.compare_exchange_strong(expected, true))
+            return false;
 
-        for (auto &file : std::filesystem::recursive_directory_iterator(corpus_directory_path))
+        // The previous thread may still be exiting after clearing the flag.
+        std::lock_guard<std::mutex> lock(indexing_thread_mutex);
+        if (indexing_thread.joinable())
+            indexing_thread.join();
+
+        indexing_thread = std::thread([this, useData]()
         {
-            std::filesystem::path fp = file.path();
-            if (fp.extension().string() != ".txt")
-                continue;
+            try
+            {
+                runIndexing(useData);
+            }
+            catch (const char* message)
+            {
+                log(message, "ERROR");
+            }
+            catch (const std::exception &e)
+            {
+                log(e.what(), "ERROR");
+            }
 
-            indexDocument(file, documents_json, term_occurrences_json, term_documents_json);
-            log(fp.string() + " - DONE", "", false, 1);
-        }
+            indexing = false;
+        });
+
+        return true;
+    }
+
+    /**
+     * @brief Whether documents are being indexed, either on background thread
+     * or by indexCorpusDirectory().
+     */
+    bool isIndexing() const
+    {
+        return indexing;
+    }
+
+    /**
+     * @brief Gets the progress of current (or last) indexing run.
+     * 
+     * @returns IndexingProgress - the progress.
+     */
+    IndexingProgress getIndexingProgress() const
+    {
+        IndexingProgress progress;
+        progress.files_done = progress_files_done;
+        progress.files_total = progress_files_total;
+        progress.bytes_done = progress_bytes_done;
+        progress.bytes_total = progress_bytes_total;
 
-        if (!getIndexSize())
+        if (progress.files_total)
         {
-            log(
-                "No searchable text documents. Place text files to be searched in "
-                + corpus_directory_path.string() + " directory and restart Search100!",
-                "WARNING"
-            );
-            return;
+            auto started = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(progress_started));
+            progress.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
         }
 
-        log("Writing index data to disk...");
-        writeJSON("documents.json", documents_json);
-        writeJSON("term_occurrences.json", term_occurrences_json);
-        writeJSON("term_documents.json", term_documents_json);
-        log("Successfully indexed " + std::to_string(getIndexSize()) + " documents...");
+        return progress;
+    }
+
+    /**
+     * @brief Gets the index segment that queries are currently served from.
+     * 
+     * @returns shared_ptr<const IndexSegment> - the segment, or nullptr if no
+     * documents are indexed.
+     */
+    std::shared_ptr<const IndexSegment> getSegment() const
+    {
+        return getSnapshot()->segment;
+    }
+
+    /**
+     * @brief Gets the index snapshot that queries are currently served from.
+     * 
+     * @returns shared_ptr<const IndexSnapshot> - the snapshot. Never nullptr.
+     */
+    std::shared_ptr<const IndexSnapshot> getSnapshot() const
+    {
+        return std::atomic_load(&snapshot);
     }
 
     /**
@@ -438,9 +1728,46 @@ class SearchEngine
      * 
      * @returns int - the index size.
      */
-    int getIndexSize()
+    int getIndexSize() const
+    {
+        auto segment = getSegment();
+        return segment ? segment->documentCount() : 0;
+    }
+
+    /**
+     * @brief The cache of stems used for indexing and searching.
+     * 
+     * The hit and miss counters of cache are cumulative across all
+     * indexing runs and search queries.
+     * 
+     * @returns StemCache& - the stem cache.
+     */
+    const StemCache &getStemCache() const
+    {
+        return stem_cache;
+    }
+
+    /**
+     * @brief The cache of search results.
+     * 
+     * Results are cached until documents are reindexed. The hit and miss counters
+     * of cache are cumulative across all search queries.
+     * 
+     * @returns ResultCache& - the result cache.
+     */
+    const ResultCache<std::vector<SearchResult>> &getResultCache() const
     {
-        return documents.size();
+        return result_cache;
+    }
+
+    /**
+     * @brief Sets the approximate maximum memory used by cached search results.
+     * 
+     * @param capacity_bytes: The capacity in bytes. Zero disables caching.
+     */
+    void setResultCacheCapacity(size_t capacity_bytes)
+    {
+        result_cache.setCapacity(capacity_bytes);
     }
 
     /**
@@ -453,12 +1780,45 @@ class SearchEngine
      * 
      * @returns filesystem::path - the path object.
      */
-    std::filesystem::path getDocumentPath(int document_id)
+    std::filesystem::path getDocumentPath(int document_id) const
+    {
+        auto segment = getSegment();
+        if (!segment || !segment->hasDocument(document_id))
+            throw -1;
+
+        return segment->documentPath(document_id);
+    }
+
+    /**
+     * @brief Gets a stemmed term by its ID, as referenced by search results.
+     * 
+     * @param term_id: The ID of term.
+     * 
+     * @returns string - the stemmed term.
+     */
+    std::string getTerm(uint32_t term_id) const
+    {
+        auto segment = getSegment();
+        if (!segment || (int)term_id >= segment->termCount())
+            throw -1;
+
+        return std::string(segment->termString(segment->termAt(term_id)));
+    }
+
+    /**
+     * @brief Gets the original (unstemmed) form of word by its ID, as referenced by occurrences.
+     * 
+     * @param surface_id: The ID of word.
+     * 
+     * @returns string - the original word.
+     */
+    std::string getSurfaceForm(uint32_t surface_id) const
     {
-        if (!documents.count(document_id))
+        auto segment = getSegment();
+        if (!segment || (int)surface_id >= segment->surfaceCount())
             throw -1;
 
-        return documents[document_id];
+        return std::string(segment->surfaceString(surface_id));
     }
 
     /**
@@ -468,41 +1828,83 @@ class SearchEngine
      * occur are returned. In contrary case, the documents that have any of searched terms
      * are returned.
      * 
+     * The query may also contain AND, OR and NOT operators, parentheses, "quoted
+     * phrases" and NEAR/k operators (see query.cpp); `search_strategy_and` is then the
+     * operator that joins words without an operator between them. Documents are
+     * ranked by the words of query that are not negated.
+     * 
+     * Results are cached (see getResultCache()) so repeating a query, or a query with
+     * the same words in a different order, does not search the index again until
+     * documents are reindexed.
+     * 
      * @param query: The search query as string.
      * @param search_strategy_and: Whether to use 'AND' strategy. If false, uses 'OR' strategy.
+     * @param max_results: The maximum number of results to return. If zero, all results
+     * are returned; otherwise only the highest ranked ones are scored in full.
+     * @param ranking: The ranking function that results are ranked by. BM25 is tuned
+     * by `bm25_k1` and `bm25_b`.
      * 
-     * @returns vector<SearchResult> - sequence of search results, sorted in descending order
-     * of relevance.
+     * @returns vector<SearchResult> - sequence of search results, one for each matched
+     * document, sorted in descending order of relevance.
      */
-    std::vector<SearchResult> search(std::string query, bool search_strategy_and = true)
+    std::vector<SearchResult> search(std::string query, bool search_strategy_and = true, size_t max_results = 0,
+                                     RankingFunction ranking = RankingFunction::TF_IDF) const
     {
-        PorterStemmer stemmer;
-        auto terms = stemmer.stemLine(query);
-
-        if (terms.empty())
-        {
-            log("Terms are not enough for query.");
+        PreparedQuery prepared;
+        if (!prepareQuery(query, search_strategy_and, ranking, prepared))
             return std::vector<SearchResult>{};
-        }
 
-        auto relevance_scores = getRelevantScores(terms, search_strategy_and);
+        return runQuery(prepared, max_results, nullptr);
+    }
 
-        std::vector<SearchResult> results;
+    /**
+     * @brief Performs a search query and returns the first page of results.
+     * 
+     * Only the results of page are ranked in full (see `max_results` of search()),
+     * so the time taken does not depend on the number of matching documents. The
+     * following pages are fetched with nextPage() using the cursor of page.
+     * 
+     * @param query: The search query as string.
+     * @param search_strategy_and: Whether to use 'AND' strategy. If false, uses 'OR' strategy.
+     * @param page_size: The maximum number of results in each page. Must not be zero.
+     * @param ranking: The ranking function that results are ranked by.
+     * 
+     * @returns SearchPage - the first page of results.
+     */
+    SearchPage searchPage(std::string query, bool search_strategy_and, size_t page_size,
+                          RankingFunction ranking = RankingFunction::TF_IDF) const
+    {
+        if (page_size == 0)
+            throw "Page size must not be zero.";
 
-        for (auto &[stem, document_id, score] : relevance_scores)
-        {
-            auto &occurrences = term_occurrences[document_id][stem.stemmed];
-            SearchResult result;
+        SearchPage page;
+        page.cursor.page_size = page_size;
 
-            result.document_id = document_id;
-            result.query_term = stem;
-            result.relevance_score = score;
-            result.occurrences = occurrences;
+        if (prepareQuery(query, search_strategy_and, ranking, page.cursor.prepared))
+            fillPage(page, true);
 
-            results.push_back(result);
-        }
+        return page;
+    }
 
-        return results;
+    /**
+     * @brief Fetches the page of results that follows a cursor.
+     * 
+     * Pages are read from the same index segment as the first page, and with the
+     * same ranking options, even if these have changed since.
+     * 
+     * @param cursor: The cursor of previous page.
+     * 
+     * @returns SearchPage - the next page, with no results if cursor has no more.
+     */
+    SearchPage nextPage(const SearchCursor &cursor) const
+    {
+        SearchPage page;
+        page.cursor = cursor;
+
+        if (cursor.hasMore())
+            fillPage(page, false);
+
+        return page;
     }
 };
 
@@ -0,0 +1,174 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_HTTP
+#define _SEARCH100_HTTP
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include "utils.cpp"
+
+/**
+ * @brief A parsed HTTP request.
+ */
+class HttpRequest
+{
+    public:
+
+    std::string method;
+    std::string path;
+
+    /* The decoded parameters of query string. */
+    std::unordered_map<std::string, std::string> params;
+
+    bool keep_alive = true;
+};
+
+/**
+ * @brief Decodes a percent-encoded component of URL, e.g. a query string parameter.
+ */
+std::string decodeUrlComponent(const std::string &data)
+{
+    std::string decoded;
+    decoded.reserve(data.size());
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        if (data[i] == '+')
+            decoded += ' ';
+        else if (data[i] == '%' && i + 2 < data.size() && std::isxdigit((unsigned char) data[i + 1])
+                 && std::isxdigit((unsigned char) data[i + 2]))
+        {
+            decoded += (char) std::stoi(data.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        }
+        else
+            decoded += data[i];
+    }
+
+    return decoded;
+}
+
+/**
+ * @brief Parses the request line and headers of an HTTP request.
+ *
+ * @param head: The request line and headers, without the empty line that ends them.
+ * @param request: The request to parse into.
+ * @param content_length: Set to the length of request body.
+ *
+ * @returns bool - false if request is malformed.
+ */
+bool parseHttpRequest(const std::string &head, HttpRequest &request, size_t &content_length)
+{
+    content_length = 0;
+
+    size_t line_end = head.find("\r\n");
+    std::string line = head.substr(0, line_end);
+
+    size_t method_end = line.find(' ');
+    size_t target_end = line.rfind(' ');
+    if (method_end == std::string::npos || target_end <= method_end)
+        return false;
+
+    request.method = line.substr(0, method_end);
+    std::string target = line.substr(method_end + 1, target_end - method_end - 1);
+    std::string version = line.substr(target_end + 1);
+
+    if (version != "HTTP/1.1" && version != "HTTP/1.0")
+        return false;
+
+    request.keep_alive = version == "HTTP/1.1";
+
+    size_t query_start = target.find('?');
+    request.path = decodeUrlComponent(target.substr(0, query_start));
+
+    if (query_start != std::string::npos)
+    {
+        std::string query_string = target.substr(query_start + 1);
+        size_t start = 0;
+
+        while (start <= query_string.size())
+        {
+            size_t end = query_string.find('&', start);
+            if (end == std::string::npos)
+                end = query_string.size();
+
+            std::string pair = query_string.substr(start, end - start);
+            size_t equals = pair.find('=');
+
+            if (!pair.empty())
+            {
+                if (equals == std::string::npos)
+                    request.params[decodeUrlComponent(pair)] = "";
+                else
+                    request.params[decodeUrlComponent(pair.substr(0, equals))] = decodeUrlComponent(pair.substr(equals + 1));
+            }
+
+            start = end + 1;
+        }
+    }
+
+    while (line_end != std::string::npos)
+    {
+        size_t start = line_end + 2;
+        line_end = head.find("\r\n", start);
+        line = head.substr(start, line_end == std::string::npos ? std::string::npos : line_end - start);
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string name = stringToLower(line.substr(0, colon));
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t") + 1);
+
+        if (name == "connection")
+        {
+            value = stringToLower(value);
+            if (value == "close")
+                request.keep_alive = false;
+            else if (value == "keep-alive")
+                request.keep_alive = true;
+        }
+        else if (name == "content-length")
+        {
+            if (value.empty() || !std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); }) || value.size() > 9)
+                return false;
+
+            content_length = std::stoul(value);
+        }
+        else if (name == "transfer-encoding")
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Builds an HTTP response with a JSON body.
+ */
+std::string buildHttpResponse(int status, const std::string &body, bool keep_alive)
+{
+    std::string reason;
+    switch (status)
+    {
+        case 200: reason = "OK"; break;
+        case 202: reason = "Accepted"; break;
+        case 400: reason = "Bad Request"; break;
+        case 404: reason = "Not Found"; break;
+        case 405: reason = "Method Not Allowed"; break;
+        case 409: reason = "Conflict"; break;
+        case 431: reason = "Request Header Fields Too Large"; break;
+        default: reason = "Internal Server Error"; break;
+    }
+
+    return "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+           "Content-Type: application/json\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: " + (keep_alive ? "keep-alive" : "close") + "\r\n"
+           "\r\n" + body;
+}
+
+#endif
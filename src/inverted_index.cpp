@@ -0,0 +1,336 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_INVERTED_INDEX
+#define _SEARCH100_INVERTED_INDEX
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Describes an indexed document file.
+ *
+ * The size, modification time and hash are recorded when document is indexed
+ * and are used to detect whether the file changed since then.
+ */
+class DocumentInfo
+{
+    public:
+
+    /**
+     * @brief The path of document.
+     */
+    std::filesystem::path path;
+
+    /**
+     * @brief The size of file in bytes.
+     */
+    uint64_t file_size = 0;
+
+    /**
+     * @brief The last modification time of file.
+     */
+    int64_t modified_time = 0;
+
+    /**
+     * @brief The FNV-1a hash of file content.
+     */
+    uint64_t content_hash = 0;
+
+    /**
+     * @brief The number of distinct terms in document.
+     */
+    uint32_t term_count = 0;
+
+    /**
+     * @brief The number of indexed words in document.
+     */
+    uint32_t token_count = 0;
+};
+
+/**
+ * @brief Describes position of a single occurrence of a term in a document.
+ */
+class IndexedPosition
+{
+    public:
+
+    /**
+     * @brief The line number in which word occurs.
+     */
+    uint32_t line = 0;
+
+    /**
+     * @brief The position of word in the line.
+     */
+    uint32_t index = 0;
+
+    /**
+     * @brief The ordinal of word among all words of document.
+     */
+    uint32_t position = 0;
+
+    /**
+     * @brief The ID of original (unstemmed) form of word in surface form dictionary.
+     */
+    uint32_t surface_id = 0;
+};
+
+/**
+ * @brief A single occurrence of a term in a document.
+ *
+ * The stemmed term and original word are referenced by their IDs in the
+ * term and surface form dictionaries of the index they were read from.
+ */
+class Occurrence
+{
+    public:
+
+    /**
+     * @brief The ID of stemmed term.
+     */
+    uint32_t term_id = 0;
+
+    /**
+     * @brief The ID of original (unstemmed) form of word.
+     */
+    uint32_t surface_id = 0;
+
+    /**
+     * @brief The ID of document in which word occurs.
+     */
+    int document_id = -1;
+
+    /**
+     * @brief The line number in which word occurs.
+     */
+    int line = -1;
+
+    /**
+     * @brief The position of word in the line.
+     */
+    int index = -1;
+
+    /**
+     * @brief The ordinal of word among all words of document.
+     */
+    int position = -1;
+};
+
+/**
+ * @brief The posting list of a single term.
+ *
+ * Postings are stored column-wise: the i-th posting consists of the i-th
+ * document ID and occurrence count. The positions of all postings are stored
+ * contiguously in order of postings, so the positions of a posting form a
+ * single block that starts at the sum of occurrence counts before it.
+ */
+class TermPostings
+{
+    public:
+
+    std::vector<uint32_t> document_ids;
+    std::vector<uint32_t> occurrence_counts;
+    std::vector<IndexedPosition> positions;
+};
+
+/**
+ * @brief In-memory inverted index that documents are indexed into.
+ *
+ * Terms are assigned IDs in order they are first seen and posting lists are
+ * stored in contiguous arrays indexed by these IDs. Original forms of words
+ * are interned the same way so each distinct word is stored only once.
+ * Documents are expected to be added in ascending order of their IDs; if that
+ * is not the case (e.g. after merging indexes built by different threads),
+ * sortPostings() restores the order.
+ */
+class InvertedIndex
+{
+    public:
+
+    /* Maps document ID to manifest entry of that document. */
+    std::map<int, DocumentInfo> documents;
+
+    /* Maps a term to its ID. */
+    std::unordered_map<std::string, uint32_t> term_ids;
+
+    /* Terms indexed by their IDs. */
+    std::vector<std::string> terms;
+
+    /* Posting lists indexed by term IDs. */
+    std::vector<TermPostings> postings;
+
+    /* Maps an original (unstemmed) word to its ID. */
+    std::unordered_map<std::string, uint32_t> surface_ids;
+
+    /* Original words indexed by their IDs. */
+    std::vector<std::string> surfaces;
+
+    /**
+     * @brief Gets the ID of a term, assigning a new one if term is not indexed yet.
+     */
+    uint32_t getTermId(const std::string &term)
+    {
+        auto [it, inserted] = term_ids.try_emplace(term, terms.size());
+        if (inserted)
+        {
+            terms.push_back(term);
+            postings.emplace_back();
+        }
+
+        return it->second;
+    }
+
+    /**
+     * @brief Gets the ID of an original word, assigning a new one if word is not seen yet.
+     */
+    uint32_t getSurfaceId(const std::string &surface)
+    {
+        auto [it, inserted] = surface_ids.try_emplace(surface, surfaces.size());
+        if (inserted)
+            surfaces.push_back(surface);
+
+        return it->second;
+    }
+
+    /**
+     * @brief Adds the occurrences of terms in a document.
+     *
+     * @param document_id: The ID of document.
+     * @param occurrences: Pairs of term ID and position, in order they occur
+     * in document.
+     */
+    void addOccurrences(int document_id, std::vector<std::pair<uint32_t, IndexedPosition>> &occurrences)
+    {
+        std::stable_sort(
+            occurrences.begin(),
+            occurrences.end(),
+            [](const std::pair<uint32_t, IndexedPosition> &a, const std::pair<uint32_t, IndexedPosition> &b)
+            {
+                return a.first < b.first;
+            }
+        );
+
+        uint32_t term_count = 0;
+
+        for (size_t i = 0; i < occurrences.size();)
+        {
+            TermPostings &term_postings = postings[occurrences[i].first];
+            size_t j = i;
+
+            while (j < occurrences.size() && occurrences[j].first == occurrences[i].first)
+                term_postings.positions.push_back(occurrences[j++].second);
+
+            term_postings.document_ids.push_back(document_id);
+            term_postings.occurrence_counts.push_back(j - i);
+            term_count++;
+            i = j;
+        }
+
+        documents[document_id].term_count = term_count;
+        documents[document_id].token_count = occurrences.size();
+    }
+
+    /**
+     * @brief Moves all documents from another index into this index.
+     *
+     * The other index is left empty. Postings may be out of order after
+     * merging so sortPostings() should be called once all indexes are merged.
+     *
+     * @param other: The index to merge.
+     */
+    void merge(InvertedIndex &other)
+    {
+        documents.merge(other.documents);
+
+        std::vector<uint32_t> surface_map(other.surfaces.size());
+        for (uint32_t i = 0; i < other.surfaces.size(); i++)
+            surface_map[i] = getSurfaceId(other.surfaces[i]);
+
+        for (TermPostings &source : other.postings)
+            for (IndexedPosition &pos : source.positions)
+                pos.surface_id = surface_map[pos.surface_id];
+
+        for (uint32_t i = 0; i < other.terms.size(); i++)
+        {
+            TermPostings &source = other.postings[i];
+            TermPostings &target = postings[getTermId(other.terms[i])];
+
+            if (target.document_ids.empty())
+            {
+                target = std::move(source);
+                continue;
+            }
+
+            target.document_ids.insert(target.document_ids.end(), source.document_ids.begin(), source.document_ids.end());
+            target.occurrence_counts.insert(target.occurrence_counts.end(), source.occurrence_counts.begin(), source.occurrence_counts.end());
+            target.positions.insert(target.positions.end(), source.positions.begin(), source.positions.end());
+        }
+
+        other.clear();
+    }
+
+    /**
+     * @brief Sorts every posting list in ascending order of document ID.
+     */
+    void sortPostings()
+    {
+        for (TermPostings &term_postings : postings)
+        {
+            auto &ids = term_postings.document_ids;
+            if (std::is_sorted(ids.begin(), ids.end()))
+                continue;
+
+            std::vector<uint64_t> starts(ids.size());
+            std::vector<uint32_t> order(ids.size());
+            uint64_t start = 0;
+
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                starts[i] = start;
+                start += term_postings.occurrence_counts[i];
+            }
+
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&ids](uint32_t a, uint32_t b) { return ids[a] < ids[b]; });
+
+            TermPostings sorted;
+            sorted.document_ids.reserve(ids.size());
+            sorted.occurrence_counts.reserve(ids.size());
+            sorted.positions.reserve(term_postings.positions.size());
+
+            for (uint32_t i : order)
+            {
+                uint32_t count = term_postings.occurrence_counts[i];
+                auto first = term_postings.positions.begin() + starts[i];
+
+                sorted.document_ids.push_back(ids[i]);
+                sorted.occurrence_counts.push_back(count);
+                sorted.positions.insert(sorted.positions.end(), first, first + count);
+            }
+
+            term_postings = std::move(sorted);
+        }
+    }
+
+    /**
+     * @brief Removes all documents and terms.
+     */
+    void clear()
+    {
+        documents.clear();
+        term_ids.clear();
+        terms.clear();
+        postings.clear();
+        surface_ids.clear();
+        surfaces.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,1153 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_QUERY
+#define _SEARCH100_QUERY
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "segment.cpp"
+#include "stemming.cpp"
+
+/**
+ * Search queries.
+ *
+ * A query is parsed into a tree of operators:
+ *
+ * - kernel driver: words next to each other are joined by the default operator of
+ *   search, i.e. AND or OR depending on search strategy.
+ * - kernel AND driver, kernel OR driver: explicit operators. AND binds tighter than
+ *   OR, and both bind looser than words joined by default operator, so with 'OR'
+ *   strategy "a b AND c" means "(a OR b) AND c".
+ * - NOT staging: excludes documents that match the operand. A negated operand among
+ *   words joined by default operator excludes documents from all of them, e.g.
+ *   "kernel driver NOT staging" means "(kernel driver) AND NOT staging".
+ * - (kernel OR driver): parentheses group operators.
+ * - "free software": a phrase; the words must occur in document next to each other
+ *   in the same order. Stop words in a phrase must be matched by some word in the
+ *   document, e.g. "terms of license" matches "terms of this license" but not
+ *   "terms license".
+ * - license NEAR/5 software: the two words must occur within 5 words of each other,
+ *   in any order.
+ *
+ * Operators are only recognized in upper case. Words are counted by their position
+ * among all words of document (see Stem::position), not by their column, so phrases
+ * may span multiple lines.
+ *
+ * The tree is evaluated by DocumentIterator objects that walk posting lists lazily,
+ * so no intermediate set of documents is built.
+ */
+
+/**
+ * @brief The largest distance accepted in NEAR operator.
+ */
+const int MAX_NEAR_DISTANCE = 1 << 20;
+
+/**
+ * @brief A phrase or proximity condition on positions of words in a document.
+ */
+class ProximityClause
+{
+    public:
+
+    /**
+     * @brief The stemmed words of clause. For phrases, positions of these relative
+     * to first word are the positions that words must occur at in document.
+     */
+    std::vector<Stem> terms;
+
+    /**
+     * @brief Whether this is a phrase. If false, this is a NEAR operator with two terms.
+     */
+    bool phrase = true;
+
+    /**
+     * @brief The largest number of words between the two terms of NEAR operator.
+     */
+    int distance = 0;
+};
+
+/**
+ * @brief The types of nodes in a query tree.
+ */
+enum class QueryOperator
+{
+    TERM,
+    CLAUSE,
+    AND,
+    OR,
+    NOT
+};
+
+/**
+ * @brief A node of query tree.
+ *
+ * An AND or OR node without children matches nothing; such nodes are removed
+ * while parsing so only the root of an empty query is one.
+ */
+class QueryNode
+{
+    public:
+
+    QueryOperator type = QueryOperator::AND;
+
+    /**
+     * @brief The stemmed word of a TERM node.
+     */
+    Stem term;
+
+    /**
+     * @brief The phrase or NEAR operator of a CLAUSE node.
+     */
+    ProximityClause clause;
+
+    /**
+     * @brief The operands of AND and OR nodes, or the single operand of NOT node.
+     */
+    std::vector<QueryNode> children;
+
+    /**
+     * @brief Whether the query has no words to search.
+     */
+    bool empty() const
+    {
+        return (type == QueryOperator::AND || type == QueryOperator::OR) && children.empty();
+    }
+
+    /**
+     * @brief Gets the stemmed words that documents are scored by, in order they occur
+     * in query. Words under NOT operators are not included.
+     */
+    std::vector<Stem> searchedTerms() const
+    {
+        std::vector<Stem> result;
+        collectTerms(result);
+        return result;
+    }
+
+    /**
+     * @brief Whether this is a single word or words joined by a single operator,
+     * without phrases or negations.
+     *
+     * @param type_out: Set to the operator, or to TERM for a single word.
+     */
+    bool isFlat(QueryOperator &type_out) const
+    {
+        type_out = type;
+
+        if (type == QueryOperator::TERM)
+            return true;
+
+        if (type != QueryOperator::AND && type != QueryOperator::OR)
+            return false;
+
+        for (auto &child : children)
+            if (child.type != QueryOperator::TERM)
+                return false;
+
+        return true;
+    }
+
+    /**
+     * @brief Gets a normalized form of query, e.g. for use as a cache key.
+     *
+     * Queries that match the same documents for the same reasons have the same
+     * normalized form: operands of AND and OR are sorted and deduplicated, and
+     * words are in stemmed form, so "Dogs cat dog" and "cats dog" are equal.
+     */
+    std::string normalized() const
+    {
+        switch (type)
+        {
+            case QueryOperator::TERM:
+                return term.stemmed;
+            case QueryOperator::CLAUSE:
+            {
+                if (!clause.phrase)
+                {
+                    std::string a = clause.terms[0].stemmed;
+                    std::string b = clause.terms[1].stemmed;
+                    return "NEAR/" + std::to_string(clause.distance) + "(" + std::min(a, b) + " " + std::max(a, b) + ")";
+                }
+
+                // Stop words are not stemmed so positions of words are part of phrase.
+                std::string result = "\"";
+                for (auto &stem : clause.terms)
+                {
+                    if (result.size() > 1)
+                        result += " ";
+
+                    result += stem.stemmed + "@" + std::to_string(stem.position - clause.terms[0].position);
+                }
+
+                return result + "\"";
+            }
+            case QueryOperator::NOT:
+                return "NOT(" + children[0].normalized() + ")";
+            default:
+            {
+                std::vector<std::string> operands;
+                for (auto &child : children)
+                    operands.push_back(child.normalized());
+
+                std::sort(operands.begin(), operands.end());
+                operands.erase(std::unique(operands.begin(), operands.end()), operands.end());
+
+                std::string result = (type == QueryOperator::AND) ? "AND(" : "OR(";
+                for (size_t i = 0; i < operands.size(); i++)
+                    result += (i ? " " : "") + operands[i];
+
+                return result + ")";
+            }
+        }
+    }
+
+    private:
+
+    void collectTerms(std::vector<Stem> &result) const
+    {
+        if (type == QueryOperator::TERM)
+            result.push_back(term);
+        else if (type == QueryOperator::CLAUSE)
+            result.insert(result.end(), clause.terms.begin(), clause.terms.end());
+        else if (type != QueryOperator::NOT)
+            for (auto &child : children)
+                child.collectTerms(result);
+    }
+};
+
+/**
+ * @brief Parses the NEAR/k operator.
+ *
+ * @param word: The word to parse.
+ * @param distance: Set to k if word is a NEAR operator.
+ *
+ * @returns bool - true if word is a NEAR operator.
+ */
+bool parseNearOperator(std::string_view word, int &distance)
+{
+    const std::string_view prefix = "NEAR/";
+    if (word.size() <= prefix.size() || word.substr(0, prefix.size()) != prefix)
+        return false;
+
+    distance = 0;
+    for (char c : word.substr(prefix.size()))
+    {
+        if (!std::isdigit((unsigned char)c))
+            return false;
+
+        distance = std::min(distance * 10 + (c - '0'), MAX_NEAR_DISTANCE);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Recursive descent parser of search queries. See parseQuery().
+ *
+ * Grammar, where a sequence joins its operands by default operator:
+ *
+ *   or       := and (OR and)*
+ *   and      := sequence (AND sequence)*
+ *   sequence := unary+
+ *   unary    := NOT unary | ( or ) | "phrase" | word (NEAR/k word)*
+ */
+class QueryParser
+{
+    enum class TokenType
+    {
+        WORD,
+        PHRASE,
+        OPEN,
+        CLOSE,
+        AND,
+        OR,
+        NOT,
+        NEAR
+    };
+
+    struct Token
+    {
+        TokenType type;
+        std::vector<Stem> stems;
+        int distance = 0;
+    };
+
+    std::vector<Token> tokens;
+    size_t current = 0;
+    QueryOperator default_operator;
+
+    void tokenize(std::string_view query, PorterStemmer &stemmer)
+    {
+        size_t i = 0;
+
+        while (i < query.size())
+        {
+            char c = query[i];
+            Token token;
+
+            if (std::isspace((unsigned char)c))
+            {
+                i++;
+                continue;
+            }
+
+            if (c == '(' || c == ')')
+            {
+                token.type = (c == '(') ? TokenType::OPEN : TokenType::CLOSE;
+                i++;
+            }
+            else if (c == '"')
+            {
+                // An unterminated quote extends to the end of query.
+                size_t end = std::min(query.find('"', i + 1), query.size());
+                token.type = TokenType::PHRASE;
+                token.stems = stemmer.stemLine(query.substr(i + 1, end - i - 1));
+                i = end + 1;
+            }
+            else
+            {
+                size_t end = i;
+                while (end < query.size() && !std::isspace((unsigned char)query[end])
+                       && query[end] != '"' && query[end] != '(' && query[end] != ')')
+                    end++;
+
+                std::string_view word = query.substr(i, end - i);
+                i = end;
+
+                if (word == "AND")
+                    token.type = TokenType::AND;
+                else if (word == "OR")
+                    token.type = TokenType::OR;
+                else if (word == "NOT")
+                    token.type = TokenType::NOT;
+                else if (parseNearOperator(word, token.distance))
+                    token.type = TokenType::NEAR;
+                else
+                {
+                    token.type = TokenType::WORD;
+                    token.stems = stemmer.stemLine(word);
+                }
+            }
+
+            tokens.push_back(std::move(token));
+        }
+    }
+
+    bool peek(TokenType type, size_t offset = 0) const
+    {
+        return current + offset < tokens.size() && tokens[current + offset].type == type;
+    }
+
+    static QueryNode makeTerm(const Stem &stem)
+    {
+        QueryNode node;
+        node.type = QueryOperator::TERM;
+        node.term = stem;
+        return node;
+    }
+
+    /* Joins operands by an operator, dropping empty operands and flattening
+       operands that are joined by the same operator. */
+    static QueryNode combine(QueryOperator type, std::vector<QueryNode> operands)
+    {
+        QueryNode node;
+        node.type = type;
+
+        for (auto &operand : operands)
+        {
+            if (operand.empty())
+                continue;
+
+            if (operand.type == type)
+                node.children.insert(node.children.end(), operand.children.begin(), operand.children.end());
+            else
+                node.children.push_back(std::move(operand));
+        }
+
+        if (node.children.size() == 1)
+        {
+            QueryNode child = std::move(node.children[0]);
+            return child;
+        }
+
+        return node;
+    }
+
+    /* Parses a word and the NEAR operators following it into the operands of
+       a sequence. The last stem of a word and the first stem of next one form
+       a NEAR clause; the other stems are plain words. */
+    void parseWord(std::vector<QueryNode> &operands)
+    {
+        std::vector<Stem> stems = tokens[current++].stems;
+        size_t first = 0;
+
+        while (peek(TokenType::NEAR) && peek(TokenType::WORD, 1) && !stems.empty()
+               && !tokens[current + 1].stems.empty())
+        {
+            for (size_t s = first; s + 1 < stems.size(); s++)
+                operands.push_back(makeTerm(stems[s]));
+
+            QueryNode node;
+            node.type = QueryOperator::CLAUSE;
+            node.clause.phrase = false;
+            node.clause.distance = tokens[current].distance;
+            node.clause.terms.push_back(stems.back());
+            node.clause.terms.push_back(tokens[current + 1].stems.front());
+            operands.push_back(std::move(node));
+
+            stems = tokens[current + 1].stems;
+            first = 1;
+            current += 2;
+        }
+
+        for (size_t s = first; s < stems.size(); s++)
+            operands.push_back(makeTerm(stems[s]));
+    }
+
+    void parseUnary(std::vector<QueryNode> &operands)
+    {
+        Token &token = tokens[current];
+
+        switch (token.type)
+        {
+            case TokenType::NOT:
+            {
+                current++;
+                if (current >= tokens.size() || peek(TokenType::CLOSE) || peek(TokenType::AND) || peek(TokenType::OR))
+                    return;
+
+                std::vector<QueryNode> operand;
+                parseUnary(operand);
+
+                QueryNode child = combine(default_operator, std::move(operand));
+                if (child.empty())
+                    return;
+
+                // Double negation cancels out.
+                if (child.type == QueryOperator::NOT)
+                {
+                    operands.push_back(std::move(child.children[0]));
+                    return;
+                }
+
+                QueryNode node;
+                node.type = QueryOperator::NOT;
+                node.children.push_back(std::move(child));
+                operands.push_back(std::move(node));
+                return;
+            }
+            case TokenType::OPEN:
+            {
+                current++;
+                operands.push_back(parseOr());
+
+                // A missing closing parenthesis is implied at the end of query.
+                if (peek(TokenType::CLOSE))
+                    current++;
+
+                return;
+            }
+            case TokenType::PHRASE:
+            {
+                current++;
+                if (token.stems.empty())
+                    return;
+
+                QueryNode node;
+                node.type = QueryOperator::CLAUSE;
+                node.clause.terms = token.stems;
+                operands.push_back(std::move(node));
+                return;
+            }
+            case TokenType::WORD:
+                parseWord(operands);
+                return;
+            default:
+                // A NEAR operator that is not between two searchable words is ignored.
+                current++;
+                return;
+        }
+    }
+
+    QueryNode parseSequence()
+    {
+        std::vector<QueryNode> positive;
+        std::vector<QueryNode> negated;
+
+        while (current < tokens.size() && !peek(TokenType::CLOSE) && !peek(TokenType::AND) && !peek(TokenType::OR))
+        {
+            std::vector<QueryNode> operands;
+            parseUnary(operands);
+
+            for (auto &operand : operands)
+                (operand.type == QueryOperator::NOT ? negated : positive).push_back(std::move(operand));
+        }
+
+        QueryNode node = combine(default_operator, std::move(positive));
+        if (negated.empty())
+            return node;
+
+        negated.insert(negated.begin(), std::move(node));
+        return combine(QueryOperator::AND, std::move(negated));
+    }
+
+    QueryNode parseAnd()
+    {
+        std::vector<QueryNode> operands;
+        operands.push_back(parseSequence());
+
+        while (peek(TokenType::AND))
+        {
+            current++;
+            operands.push_back(parseSequence());
+        }
+
+        return combine(QueryOperator::AND, std::move(operands));
+    }
+
+    QueryNode parseOr()
+    {
+        std::vector<QueryNode> operands;
+        operands.push_back(parseAnd());
+
+        while (peek(TokenType::OR))
+        {
+            current++;
+            operands.push_back(parseAnd());
+        }
+
+        return combine(QueryOperator::OR, std::move(operands));
+    }
+
+    public:
+
+    /**
+     * @param query: The search query.
+     * @param stemmer: The stemmer to stem words with.
+     * @param search_strategy_and: Whether words are joined by AND by default. If false,
+     * they are joined by OR.
+     */
+    QueryParser(std::string_view query, PorterStemmer &stemmer, bool search_strategy_and)
+    {
+        default_operator = search_strategy_and ? QueryOperator::AND : QueryOperator::OR;
+        tokenize(query, stemmer);
+    }
+
+    /**
+     * @brief Parses the query.
+     *
+     * @returns QueryNode - the root of query tree.
+     */
+    QueryNode parse()
+    {
+        std::vector<QueryNode> operands;
+        operands.push_back(parseOr());
+
+        // Unmatched closing parentheses are ignored.
+        while (current < tokens.size())
+        {
+            current++;
+            operands.push_back(parseOr());
+        }
+
+        return combine(default_operator, std::move(operands));
+    }
+};
+
+/**
+ * @brief Parses a search query. See QueryParser for the grammar.
+ *
+ * Malformed queries are parsed leniently: operators without operands, words that
+ * have no searchable stems (e.g. stop words) and unmatched parentheses are ignored.
+ *
+ * @param query: The search query.
+ * @param stemmer: The stemmer to stem words with.
+ * @param search_strategy_and: Whether words are joined by AND by default. If false,
+ * they are joined by OR.
+ *
+ * @returns QueryNode - the root of query tree. Empty if query has no words to search.
+ */
+QueryNode parseQuery(std::string_view query, PorterStemmer &stemmer, bool search_strategy_and = true)
+{
+    return QueryParser(query, stemmer, search_strategy_and).parse();
+}
+
+/**
+ * @brief Checks whether the words of a clause occur in a document as required.
+ *
+ * Positions of each term are in ascending order so they are merged in a single
+ * pass: for phrases, each position of first term is checked against following
+ * terms at their offsets, and for NEAR the two lists are walked together.
+ *
+ * @param clause: The clause to check.
+ * @param positions: For each term of clause, its positions in document and the
+ * number of positions.
+ *
+ * @returns bool - true if clause matches the document.
+ */
+bool matchClause(const ProximityClause &clause, const std::vector<std::pair<const SegmentPosition*, uint32_t>> &positions)
+{
+    if (!clause.phrase)
+    {
+        auto [a, a_count] = positions[0];
+        auto [b, b_count] = positions[1];
+        uint32_t i = 0;
+        uint32_t j = 0;
+
+        while (i < a_count && j < b_count)
+        {
+            uint32_t a_position = a[i].position;
+            uint32_t b_position = b[j].position;
+
+            if (std::max(a_position, b_position) - std::min(a_position, b_position) <= (uint32_t)clause.distance)
+                return true;
+
+            if (a_position < b_position)
+                i++;
+            else
+                j++;
+        }
+
+        return false;
+    }
+
+    std::vector<uint32_t> next(positions.size(), 0);
+    auto [first, first_count] = positions[0];
+
+    for (uint32_t k = 0; k < first_count; k++)
+    {
+        bool matched = true;
+
+        for (size_t t = 1; t < positions.size() && matched; t++)
+        {
+            auto [list, count] = positions[t];
+            uint64_t target = (uint64_t)first[k].position + (clause.terms[t].position - clause.terms[0].position);
+
+            while (next[t] < count && list[next[t]].position < target)
+                next[t]++;
+
+            // No later position of first term can match either.
+            if (next[t] == count)
+                return false;
+
+            matched = (list[next[t]].position == target);
+        }
+
+        if (matched)
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Iterates over the documents matching a query tree node, in ascending order
+ * of document ID.
+ *
+ * Iterators are lazy: documents are only found as the iterator is advanced, and
+ * the posting lists beneath it are skipped through rather than read in full.
+ */
+class DocumentIterator
+{
+    public:
+
+    virtual ~DocumentIterator() = default;
+
+    /**
+     * @brief Whether all matching documents have been iterated.
+     */
+    virtual bool atEnd() const = 0;
+
+    /**
+     * @brief The current document ID. Iterator must not be at end.
+     */
+    virtual uint32_t document() const = 0;
+
+    /**
+     * @brief Moves to the first matching document with ID not less than target. If
+     * current document is not less than target, the iterator is left unchanged.
+     *
+     * @param target: The document ID to advance to.
+     *
+     * @returns bool - false if there is no such document and iterator is at end.
+     */
+    virtual bool advance(uint32_t target) = 0;
+
+    /**
+     * @brief The largest number of documents that the iterator may match. Used to
+     * advance the rarest operands of AND first.
+     */
+    virtual uint64_t cost() const = 0;
+
+    /**
+     * @brief Moves to the next matching document. Iterator must not be at end.
+     */
+    void next()
+    {
+        advance(document() + 1);
+    }
+};
+
+/**
+ * @brief Iterates over the documents in which a term occurs.
+ */
+class TermIterator : public DocumentIterator
+{
+    PostingCursor cursor;
+    uint32_t document_frequency;
+
+    public:
+
+    TermIterator(const IndexSegment &segment, const SegmentTerm &term) : cursor(segment, term)
+    {
+        document_frequency = term.document_frequency;
+    }
+
+    bool atEnd() const override
+    {
+        return cursor.atEnd();
+    }
+
+    uint32_t document() const override
+    {
+        return cursor.document();
+    }
+
+    bool advance(uint32_t target) override
+    {
+        return cursor.advance(target);
+    }
+
+    uint64_t cost() const override
+    {
+        return document_frequency;
+    }
+};
+
+/**
+ * @brief Iterates over all documents of a segment. Used as the operand of queries
+ * that only exclude documents, e.g. "NOT staging".
+ */
+class AllDocumentsIterator : public DocumentIterator
+{
+    uint32_t current = 0;
+    uint32_t count;
+
+    public:
+
+    AllDocumentsIterator(const IndexSegment &segment)
+    {
+        count = segment.documentCount();
+    }
+
+    bool atEnd() const override
+    {
+        return current >= count;
+    }
+
+    uint32_t document() const override
+    {
+        return current;
+    }
+
+    bool advance(uint32_t target) override
+    {
+        current = std::max(current, target);
+        return !atEnd();
+    }
+
+    uint64_t cost() const override
+    {
+        return count;
+    }
+};
+
+/**
+ * @brief Iterates over the documents matched by all of the required iterators and
+ * none of the excluded ones.
+ *
+ * Required iterators are advanced in ascending order of cost, each to the document
+ * that the previous ones agree on. Once they all agree, excluded iterators are
+ * advanced to that document and it is skipped if any of them is at it. Candidates
+ * only increase, so excluded iterators are advanced lazily in a single pass too.
+ */
+class ConjunctionIterator : public DocumentIterator
+{
+    std::vector<std::unique_ptr<DocumentIterator>> required;
+    std::vector<std::unique_ptr<DocumentIterator>> excluded;
+    uint32_t current = 0;
+    bool at_end = false;
+
+    bool findMatch(uint32_t candidate)
+    {
+        size_t agreed = 0;
+
+        while (agreed < required.size())
+        {
+            for (agreed = 0; agreed < required.size(); agreed++)
+            {
+                if (!required[agreed]->advance(candidate))
+                {
+                    at_end = true;
+                    return false;
+                }
+
+                if (required[agreed]->document() != candidate)
+                {
+                    candidate = required[agreed]->document();
+                    break;
+                }
+            }
+
+            if (agreed < required.size())
+                continue;
+
+            for (auto &iterator : excluded)
+            {
+                if (iterator->advance(candidate) && iterator->document() == candidate)
+                {
+                    candidate++;
+                    agreed = 0;
+                    break;
+                }
+            }
+        }
+
+        current = candidate;
+        return true;
+    }
+
+    public:
+
+    /**
+     * @param required_iterators: The iterators that documents must be matched by. Must
+     * not be empty.
+     * @param excluded_iterators: The iterators that documents must not be matched by.
+     */
+    ConjunctionIterator(std::vector<std::unique_ptr<DocumentIterator>> required_iterators,
+                        std::vector<std::unique_ptr<DocumentIterator>> excluded_iterators)
+    {
+        required = std::move(required_iterators);
+        excluded = std::move(excluded_iterators);
+
+        std::stable_sort(required.begin(), required.end(), [](auto &a, auto &b) {
+            return a->cost() < b->cost();
+        });
+
+        findMatch(0);
+    }
+
+    bool atEnd() const override
+    {
+        return at_end;
+    }
+
+    uint32_t document() const override
+    {
+        return current;
+    }
+
+    bool advance(uint32_t target) override
+    {
+        if (at_end || current >= target)
+            return !at_end;
+
+        return findMatch(target);
+    }
+
+    uint64_t cost() const override
+    {
+        return required[0]->cost();
+    }
+};
+
+/**
+ * @brief Iterates over the documents matched by any of the given iterators.
+ */
+class DisjunctionIterator : public DocumentIterator
+{
+    std::vector<std::unique_ptr<DocumentIterator>> iterators;
+    uint32_t current = 0;
+    bool at_end = false;
+
+    void findMinimum()
+    {
+        at_end = true;
+
+        for (auto &iterator : iterators)
+        {
+            if (iterator->atEnd())
+                continue;
+
+            if (at_end || iterator->document() < current)
+                current = iterator->document();
+
+            at_end = false;
+        }
+    }
+
+    public:
+
+    /**
+     * @param operand_iterators: The iterators to merge. Must not be empty.
+     */
+    DisjunctionIterator(std::vector<std::unique_ptr<DocumentIterator>> operand_iterators)
+    {
+        iterators = std::move(operand_iterators);
+        findMinimum();
+    }
+
+    bool atEnd() const override
+    {
+        return at_end;
+    }
+
+    uint32_t document() const override
+    {
+        return current;
+    }
+
+    bool advance(uint32_t target) override
+    {
+        if (at_end || current >= target)
+            return !at_end;
+
+        for (auto &iterator : iterators)
+            iterator->advance(target);
+
+        findMinimum();
+        return !at_end;
+    }
+
+    uint64_t cost() const override
+    {
+        uint64_t total = 0;
+        for (auto &iterator : iterators)
+            total += iterator->cost();
+
+        return total;
+    }
+};
+
+/**
+ * @brief Iterates over the documents in which a phrase or NEAR clause matches.
+ *
+ * The posting lists of clause terms are intersected first, rarest term first, and
+ * positions are only read for documents that contain every term.
+ */
+class ClauseIterator : public DocumentIterator
+{
+    const IndexSegment* segment;
+    const ProximityClause* clause;
+
+    /* Cursors in order of clause terms, and their indices in ascending order of
+       document frequency. */
+    std::vector<PostingCursor> cursors;
+    std::vector<size_t> order;
+    std::vector<std::pair<const SegmentPosition*, uint32_t>> positions;
+    uint64_t min_frequency = 0;
+    uint32_t current = 0;
+    bool at_end = false;
+
+    bool findMatch(uint32_t candidate)
+    {
+        while (true)
+        {
+            size_t agreed;
+            for (agreed = 0; agreed < order.size(); agreed++)
+            {
+                PostingCursor &cursor = cursors[order[agreed]];
+                if (!cursor.advance(candidate))
+                {
+                    at_end = true;
+                    return false;
+                }
+
+                if (cursor.document() != candidate)
+                {
+                    candidate = cursor.document();
+                    break;
+                }
+            }
+
+            if (agreed < order.size())
+                continue;
+
+            for (size_t i = 0; i < cursors.size(); i++)
+            {
+                SegmentPosting posting = cursors[i].posting();
+                positions[i] = std::make_pair(segment->postingPositions(posting), posting.occurrence_count);
+            }
+
+            if (matchClause(*clause, positions))
+            {
+                current = candidate;
+                return true;
+            }
+
+            candidate++;
+        }
+    }
+
+    public:
+
+    /**
+     * @param segment_inst: The segment to search in.
+     * @param clause_inst: The clause to match. Must outlive the iterator.
+     * @param terms: The term entries of clause terms, in order of clause terms. Must
+     * not contain nullptr.
+     */
+    ClauseIterator(const IndexSegment &segment_inst, const ProximityClause &clause_inst,
+                   const std::vector<const SegmentTerm*> &terms)
+    {
+        segment = &segment_inst;
+        clause = &clause_inst;
+        positions.resize(terms.size());
+
+        for (size_t i = 0; i < terms.size(); i++)
+        {
+            cursors.emplace_back(segment_inst, *terms[i]);
+            order.push_back(i);
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&terms](size_t a, size_t b) {
+            return terms[a]->document_frequency < terms[b]->document_frequency;
+        });
+
+        min_frequency = terms[order[0]]->document_frequency;
+        findMatch(0);
+    }
+
+    bool atEnd() const override
+    {
+        return at_end;
+    }
+
+    uint32_t document() const override
+    {
+        return current;
+    }
+
+    bool advance(uint32_t target) override
+    {
+        if (at_end || current >= target)
+            return !at_end;
+
+        return findMatch(target);
+    }
+
+    uint64_t cost() const override
+    {
+        return min_frequency;
+    }
+};
+
+/**
+ * @brief Builds the iterator over documents matching a query tree node.
+ *
+ * @param segment: The segment to search in.
+ * @param node: The query tree node. Must outlive the iterator.
+ *
+ * @returns unique_ptr<DocumentIterator> - the iterator, or nullptr if no document
+ * can match the node (e.g. one of its required words is not indexed).
+ */
+std::unique_ptr<DocumentIterator> buildIterator(const IndexSegment &segment, const QueryNode &node)
+{
+    switch (node.type)
+    {
+        case QueryOperator::TERM:
+        {
+            const SegmentTerm* entry = segment.findTerm(node.term.stemmed);
+            if (!entry)
+                return nullptr;
+
+            return std::make_unique<TermIterator>(segment, *entry);
+        }
+        case QueryOperator::CLAUSE:
+        {
+            std::vector<const SegmentTerm*> terms;
+            for (const Stem &term : node.clause.terms)
+            {
+                const SegmentTerm* entry = segment.findTerm(term.stemmed);
+                if (!entry)
+                    return nullptr;
+
+                terms.push_back(entry);
+            }
+
+            return std::make_unique<ClauseIterator>(segment, node.clause, terms);
+        }
+        case QueryOperator::OR:
+        {
+            std::vector<std::unique_ptr<DocumentIterator>> operands;
+            for (auto &child : node.children)
+            {
+                auto iterator = buildIterator(segment, child);
+                if (iterator && !iterator->atEnd())
+                    operands.push_back(std::move(iterator));
+            }
+
+            if (operands.empty())
+                return nullptr;
+
+            if (operands.size() == 1)
+                return std::move(operands[0]);
+
+            return std::make_unique<DisjunctionIterator>(std::move(operands));
+        }
+        default:
+        {
+            // AND and NOT nodes; a NOT node on its own excludes from all documents.
+            std::vector<std::unique_ptr<DocumentIterator>> required;
+            std::vector<std::unique_ptr<DocumentIterator>> excluded;
+            std::vector<const QueryNode*> operands;
+
+            if (node.type == QueryOperator::NOT)
+                operands.push_back(&node);
+            else
+                for (auto &child : node.children)
+                    operands.push_back(&child);
+
+            for (const QueryNode* operand : operands)
+            {
+                bool negated = (operand->type == QueryOperator::NOT);
+                auto iterator = buildIterator(segment, negated ? operand->children[0] : *operand);
+
+                if (negated)
+                {
+                    if (iterator && !iterator->atEnd())
+                        excluded.push_back(std::move(iterator));
+                }
+                else if (!iterator || iterator->atEnd())
+                {
+                    return nullptr;
+                }
+                else
+                {
+                    required.push_back(std::move(iterator));
+                }
+            }
+
+            if (required.empty())
+            {
+                if (segment.documentCount() == 0)
+                    return nullptr;
+
+                required.push_back(std::make_unique<AllDocumentsIterator>(segment));
+            }
+
+            if (required.size() == 1 && excluded.empty())
+                return std::move(required[0]);
+
+            return std::make_unique<ConjunctionIterator>(std::move(required), std::move(excluded));
+        }
+    }
+}
+
+#endif
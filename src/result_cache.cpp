@@ -0,0 +1,200 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_RESULT_CACHE
+#define _SEARCH100_RESULT_CACHE
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Least recently used cache of query results, bounded by memory.
+ *
+ * Values are shared so a hit does not copy the cached value while the cache
+ * is locked, and an evicted value stays valid for whoever is still using it.
+ *
+ * Cached values belong to a generation of index (see SearchEngine::setSegment()).
+ * When the generation changes, all values are dropped and values computed from
+ * an older generation are no longer inserted, so stale results are never returned.
+ */
+template <typename Value>
+class ResultCache
+{
+    struct Entry
+    {
+        std::string key;
+        std::shared_ptr<const Value> value;
+        size_t size;
+    };
+
+    /* Entries in order of use, most recently used first. */
+    std::list<Entry> entries;
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> lookup;
+    mutable std::mutex mutex;
+
+    uint64_t generation = 0;
+    size_t capacity;
+    size_t used = 0;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    /* Removes least recently used entries until cache fits in its capacity. Must be
+       called with mutex held. */
+    void evict()
+    {
+        while (used > capacity && !entries.empty())
+        {
+            used -= entries.back().size;
+            lookup.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    public:
+
+    /**
+     * @param capacity_bytes: The approximate maximum memory used by cached values.
+     */
+    ResultCache(size_t capacity_bytes = 64 * 1024 * 1024)
+    {
+        capacity = capacity_bytes;
+    }
+
+    /**
+     * @brief Looks up a cached value.
+     *
+     * @param key: The key of value.
+     *
+     * @returns shared_ptr<const Value> - the value, or nullptr if it is not in cache.
+     */
+    std::shared_ptr<const Value> find(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = lookup.find(key);
+        if (it == lookup.end())
+        {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        hits.fetch_add(1, std::memory_order_relaxed);
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->value;
+    }
+
+    /**
+     * @brief Adds a value to cache, evicting least recently used values to make room.
+     *
+     * Values larger than capacity of cache, and values of a generation other than
+     * the current one, are not added.
+     *
+     * @param key: The key of value.
+     * @param value_generation: The index generation that value was computed from.
+     * @param value: The value.
+     * @param size: The approximate memory used by value, in bytes.
+     */
+    void insert(const std::string &key, uint64_t value_generation, std::shared_ptr<const Value> value, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size += key.size() + sizeof(Entry);
+        if (value_generation != generation || size > capacity)
+            return;
+
+        auto it = lookup.find(key);
+        if (it != lookup.end())
+        {
+            used -= it->second->size;
+            entries.erase(it->second);
+            lookup.erase(it);
+        }
+
+        entries.push_front(Entry{key, std::move(value), size});
+        lookup[key] = entries.begin();
+        used += size;
+        evict();
+    }
+
+    /**
+     * @brief Sets the current index generation, dropping all values if it changed.
+     */
+    void setGeneration(uint64_t current_generation)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (generation == current_generation)
+            return;
+
+        generation = current_generation;
+        entries.clear();
+        lookup.clear();
+        used = 0;
+    }
+
+    /**
+     * @brief Sets the approximate maximum memory used by cached values, evicting
+     * values if cache no longer fits. Zero disables caching.
+     */
+    void setCapacity(size_t capacity_bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        capacity = capacity_bytes;
+        evict();
+    }
+
+    /**
+     * @brief Removes all values from cache and resets the counters.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        entries.clear();
+        lookup.clear();
+        used = 0;
+        hits = 0;
+        misses = 0;
+    }
+
+    /**
+     * @brief The number of lookups that found the value in cache.
+     */
+    uint64_t getHits() const
+    {
+        return hits.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The number of lookups that did not find the value in cache.
+     */
+    uint64_t getMisses() const
+    {
+        return misses.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The number of cached values.
+     */
+    size_t getCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    /**
+     * @brief The approximate memory used by cached values, in bytes.
+     */
+    size_t getSize() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used;
+    }
+};
+
+#endif
@@ -0,0 +1,234 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_SCORING
+#define _SEARCH100_SCORING
+
+#include <cmath>
+#include <cstdint>
+#include "segment.cpp"
+
+/**
+ * Ranking functions.
+ *
+ * A scorer computes how relevant a searched term is in a document; the relevance
+ * score of a document is the sum of scores of searched terms that occur in it.
+ * Scorers are passed to SearchEngine::getRelevantScores() as a template parameter
+ * so scoring a posting is an inlined call rather than a virtual one. Every scorer
+ * provides the following methods:
+ *
+ * - termWeight(term): the part of score that only depends on the term. This is
+ *   computed once for each searched term.
+ * - score(weight, posting): the score of term in the document of posting.
+ * - maxScore(weight, entry): the upper bound of score of term in any document of
+ *   a term or posting block entry, used to skip documents that cannot rank high
+ *   enough.
+ */
+
+/**
+ * @brief The ranking functions that search results can be ranked by.
+ */
+enum class RankingFunction
+{
+    TF_IDF,
+    BM25
+};
+
+/**
+ * @brief Scores documents using TF-IDF.
+ */
+class TfIdfScorer
+{
+    const IndexSegment* segment;
+
+    public:
+
+    TfIdfScorer(const IndexSegment &segment_inst)
+    {
+        segment = &segment_inst;
+    }
+
+    /**
+     * @brief Computes the term frequency (TF) of a term in a document.
+     *
+     * TF(t, d) = (number of times t occurs in d) / (total number of terms in d)
+     *
+     * t: the targeted term
+     * d: the targeted document
+     *
+     * TF is the measure of how frequent a term occurs in a document. The
+     * value ranges between 0-1 with higher values indicating higher frequency.
+     *
+     * https://en.wikipedia.org/wiki/Tf%E2%80%93idf#Term_frequency
+     *
+     * The occurrence count is stored in the posting and the number of terms in
+     * the document lengths table of segment, so both are plain array reads.
+     *
+     * @param posting: The posting of term for the document to find TF in.
+     *
+     * @returns double - TF value.
+     */
+    double computeTF(const SegmentPosting &posting) const
+    {
+        double term_freq = (double)posting.occurrence_count;
+        double total_terms = (double)segment->documentTermCount(posting.document_id);
+
+        return term_freq / total_terms;
+    }
+
+    /**
+     * @brief Computes the inverse document frequency (IDF) value for given term.
+     *
+     * IDF(t) = (number of documents in corpus) / (number of documents containing t)
+     *
+     * t: the targeted term
+     *
+     * IDF is measure of how rare the term is in corpus documents. Higher IDF value
+     * for a term indicates that the term is rare and lower value indicates less rare
+     * or common terms.
+     *
+     * https://en.wikipedia.org/wiki/Tf%E2%80%93idf#Inverse_document_frequency
+     *
+     * The IDF only depends on the corpus so it is computed once for each term when
+     * the segment is written (see writeSegment()) and read from term dictionary here.
+     *
+     * @param term: The term dictionary entry to find IDF for.
+     *
+     * @returns double - IDF value.
+     */
+    double computeIDF(const SegmentTerm &term) const
+    {
+        return term.idf;
+    }
+
+    /**
+     * @brief Computes the TF-IDF value for given term in given document.
+     *
+     * TF-IDF is measure for how relevant a term is in a document. That is,
+     * terms with higher TF-IDF values are ranked higher in search results
+     * as such terms are more relevant. TF-IDF is therefore referred to as
+     * relevance or importance score.
+     *
+     * https://en.wikipedia.org/wiki/Tf%E2%80%93idf#Term_frequency%E2%80%93inverse_document_frequency
+     *
+     * @param term: The term dictionary entry to find TF-IDF for.
+     * @param posting: The posting of term for the document to find TF-IDF in.
+     *
+     * @returns double - TF-IDF value.
+     */
+    double computeTfIdf(const SegmentTerm &term, const SegmentPosting &posting) const
+    {
+        return score(termWeight(term), posting);
+    }
+
+    /**
+     * @brief Gets the weight of a term, i.e. its IDF.
+     */
+    double termWeight(const SegmentTerm &term) const
+    {
+        return computeIDF(term);
+    }
+
+    /**
+     * @brief Gets the TF-IDF of a term in document of posting.
+     */
+    double score(double weight, const SegmentPosting &posting) const
+    {
+        return weight * computeTF(posting);
+    }
+
+    /**
+     * @brief Gets the upper bound of TF-IDF of a term in documents of a term or
+     * posting block entry.
+     */
+    template <typename Entry>
+    double maxScore(double weight, const Entry &entry) const
+    {
+        return weight * entry.max_term_frequency;
+    }
+};
+
+/**
+ * @brief Scores documents using Okapi BM25.
+ *
+ * BM25(t, d) = IDF(t) * f * (k1 + 1) / (f + k1 * (1 - b + b * |d| / avgdl))
+ * IDF(t) = ln(1 + (N - n + 0.5) / (n + 0.5))
+ *
+ * f: the number of times t occurs in d
+ * |d|: the number of words in d
+ * avgdl: the average number of words in corpus documents
+ * N: the number of documents in corpus
+ * n: the number of documents containing t
+ *
+ * Unlike TF, the score of a term saturates as it occurs more often; k1 controls
+ * how quickly it does so, and b controls how much long documents are penalized.
+ *
+ * https://en.wikipedia.org/wiki/Okapi_BM25
+ */
+class BM25Scorer
+{
+    const IndexSegment* segment;
+    double k1;
+
+    /* The length normalization k1 * (1 - b + b * |d| / avgdl) is computed as
+       length_base + length_factor * |d|. */
+    double length_base;
+    double length_factor;
+
+    double termScore(double weight, uint32_t occurrence_count, uint32_t token_count) const
+    {
+        double f = (double)occurrence_count;
+        return weight * f * (k1 + 1) / (f + length_base + length_factor * token_count);
+    }
+
+    public:
+
+    /**
+     * @param segment_inst: The segment that terms and postings are read from.
+     * @param k1_value: The term frequency saturation parameter. Must not be negative.
+     * @param b: The document length normalization parameter, between 0 and 1.
+     */
+    BM25Scorer(const IndexSegment &segment_inst, double k1_value = 1.2, double b = 0.75)
+    {
+        if (!(k1_value >= 0) || !(b >= 0 && b <= 1))
+            throw "BM25 parameters must satisfy k1 >= 0 and 0 <= b <= 1.";
+
+        segment = &segment_inst;
+        k1 = k1_value;
+        length_base = k1 * (1 - b);
+        length_factor = k1 * b / segment->averageDocumentLength();
+    }
+
+    /**
+     * @brief Gets the weight of a term, i.e. its BM25 IDF.
+     */
+    double termWeight(const SegmentTerm &term) const
+    {
+        double total_docs = (double)segment->documentCount();
+        double df = (double)term.document_frequency;
+
+        return std::log(1 + (total_docs - df + 0.5) / (df + 0.5));
+    }
+
+    /**
+     * @brief Gets the BM25 score of a term in document of posting.
+     */
+    double score(double weight, const SegmentPosting &posting) const
+    {
+        return termScore(weight, posting.occurrence_count, segment->documentTokenCount(posting.document_id));
+    }
+
+    /**
+     * @brief Gets the upper bound of BM25 score of a term in documents of a term or
+     * posting block entry.
+     *
+     * The score grows with occurrence count and shrinks with document length, so
+     * it is bounded by the score of largest count in the shortest document.
+     */
+    template <typename Entry>
+    double maxScore(double weight, const Entry &entry) const
+    {
+        return termScore(weight, entry.max_occurrence_count, entry.min_token_count);
+    }
+};
+
+#endif
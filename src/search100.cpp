@@ -76,13 +76,17 @@ int main()
         if (!data.indexes_loaded)
             status_bar.text.setString("Preparing indexes...");
 
+        if (engine.isIndexing())
+            status_bar.showIndexingProgress(engine.getIndexingProgress(), engine.getIndexSize());
+
         state->draw(window, state, data);
         status_bar.draw(window, state, data);
         window.display();
 
-        if (!data.indexes_loaded)
+        // Documents are indexed in background so the window stays responsive. A
+        // reindex requested during indexing starts once current indexing finishes.
+        if (!data.indexes_loaded && engine.startIndexing(data.indexes_use_data))
         {
-            engine.indexCorpusDirectory(data.indexes_use_data);
             data.indexes_loaded = true;
             data.indexes_use_data = false;
         }
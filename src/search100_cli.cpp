@@ -0,0 +1,397 @@
+/**
+ *  Search100 CLI
+ *
+ * Command line interface of Search100 for indexing and searching without
+ * the graphical interface, e.g. in scripts and on servers.
+ *
+ * Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025
+ *
+ * */
+
+#ifndef _SEARCH100_CLI
+#define _SEARCH100_CLI
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.cpp"
+#include "thread_pool.cpp"
+#include "utils.cpp"
+
+/**
+ * @brief The number of results fetched at a time when all results of a query are output.
+ */
+const size_t CLI_PAGE_SIZE = 100;
+
+/**
+ * @brief The number of queries read from standard input before they are searched
+ * in batch mode. Results are output once all queries read are searched.
+ */
+const size_t CLI_BATCH_SIZE = 256;
+
+const std::string CLI_USAGE =
+    "Usage: search100-cli <command> [options] [query]\n"
+    "\n"
+    "Commands:\n"
+    "  index           Index the corpus directory and write the index.\n"
+    "  query <query>   Search the index and output the results.\n"
+    "  batch-query     Search each line of standard input as a query.\n"
+    "\n"
+    "Options:\n"
+    "  --corpus <dir>     The corpus directory. (default: corpus/)\n"
+    "  --full             index: Index all documents, not only the changed ones.\n"
+    "  --or               Use 'OR' searching strategy instead of 'AND'.\n"
+    "  --ranking <name>   The ranking function, tfidf or bm25. (default: tfidf)\n"
+    "  --limit <n>        The maximum number of results of each query, 0 for all. (default: 10)\n"
+    "  --format <name>    The output format, tsv or json. (default: tsv)\n"
+    "  --threads <n>      batch-query: The number of queries searched at once. (default: one per core)\n";
+
+/**
+ * @brief The options of command line, see CLI_USAGE.
+ */
+class CliOptions
+{
+    public:
+
+    std::string command;
+    std::string query;
+    std::string corpus = "corpus/";
+    bool full = false;
+    bool search_strategy_and = true;
+    RankingFunction ranking = RankingFunction::TF_IDF;
+    size_t limit = 10;
+    bool json = false;
+    size_t threads = 0;
+};
+
+/**
+ * @brief The results of a single query, see runCliQuery().
+ */
+class CliResults
+{
+    public:
+
+    std::vector<SearchResult> results;
+
+    /* Whether more results matched than the limit. */
+    bool more = false;
+
+    /* The error that query failed with, if not empty. */
+    std::string error;
+};
+
+/**
+ * @brief Parses a non-negative integer argument of at most nine digits, throwing if
+ * it is not one.
+ */
+size_t parseCliCount(const std::string &option, const std::string &value)
+{
+    if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); }))
+        throw "Option " + option + " expects a non-negative integer.";
+
+    return std::stoul(value);
+}
+
+/**
+ * @brief Parses command line arguments.
+ *
+ * Throws a string describing the error if arguments are invalid.
+ *
+ * @returns CliOptions - the parsed options.
+ */
+CliOptions parseCliOptions(int argc, char* argv[])
+{
+    CliOptions options;
+    std::vector<std::string> words;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "--full")
+        {
+            options.full = true;
+            continue;
+        }
+        if (arg == "--or")
+        {
+            options.search_strategy_and = false;
+            continue;
+        }
+        if (arg.size() < 2 || arg.compare(0, 2, "--") != 0)
+        {
+            words.push_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc)
+            throw "Option " + arg + " expects a value.";
+
+        std::string value = argv[++i];
+
+        if (arg == "--corpus")
+        {
+            options.corpus = value;
+            if (options.corpus.back() != '/' && options.corpus.back() != '\\')
+                options.corpus += '/';
+        }
+        else if (arg == "--ranking")
+        {
+            if (value == "tfidf")
+                options.ranking = RankingFunction::TF_IDF;
+            else if (value == "bm25")
+                options.ranking = RankingFunction::BM25;
+            else
+                throw "Unknown ranking function: " + value;
+        }
+        else if (arg == "--limit")
+            options.limit = parseCliCount(arg, value);
+        else if (arg == "--format")
+        {
+            if (value != "tsv" && value != "json")
+                throw "Unknown output format: " + value;
+
+            options.json = value == "json";
+        }
+        else if (arg == "--threads")
+            options.threads = parseCliCount(arg, value);
+        else
+            throw "Unknown option: " + arg;
+    }
+
+    if (words.empty())
+        throw std::string("No command given.");
+
+    options.command = words[0];
+
+    if (options.command == "query")
+    {
+        if (words.size() < 2)
+            throw std::string("No query given.");
+
+        // Unquoted words of query are passed as separate arguments.
+        for (size_t i = 1; i < words.size(); i++)
+            options.query += (i > 1 ? " " : "") + words[i];
+    }
+    else if (options.command == "index" || options.command == "batch-query")
+    {
+        if (words.size() > 1)
+            throw "Unexpected argument: " + words[1];
+    }
+    else
+        throw "Unknown command: " + options.command;
+
+    return options;
+}
+
+/**
+ * @brief Searches a query, fetching results page by page until the limit is reached.
+ *
+ * @param engine: The engine to search.
+ * @param options: The options to search with.
+ * @param query: The query to search.
+ *
+ * @returns CliResults - the results.
+ */
+CliResults runCliQuery(const SearchEngine &engine, const CliOptions &options, const std::string &query)
+{
+    CliResults output;
+
+    try
+    {
+        size_t page_size = options.limit ? options.limit : CLI_PAGE_SIZE;
+        SearchPage page = engine.searchPage(query, options.search_strategy_and, page_size, options.ranking);
+        output.results = std::move(page.results);
+
+        while (!options.limit && page.cursor.hasMore())
+        {
+            page = engine.nextPage(page.cursor);
+            output.results.insert(output.results.end(), page.results.begin(), page.results.end());
+        }
+
+        output.more = page.cursor.hasMore();
+    }
+    catch (const char* message)
+    {
+        output.results.clear();
+        output.error = message;
+    }
+    catch (const std::exception &e)
+    {
+        output.results.clear();
+        output.error = e.what();
+    }
+
+    return output;
+}
+
+/**
+ * @brief Writes the results of a query to standard output.
+ *
+ * In TSV format, each result is a line of rank, relevance score, number of
+ * occurrences of searched terms and document path. In JSON format, the results
+ * of query are a single line.
+ *
+ * @param options: The options that query was searched with.
+ * @param query: The query.
+ * @param output: The results of query.
+ * @param line: In batch mode, the line of standard input that query was read
+ * from. It is output before the results in TSV format. Zero otherwise.
+ */
+void printCliResults(const CliOptions &options, const std::string &query, const CliResults &output, size_t line)
+{
+    if (!output.error.empty())
+        log((line ? "Line " + std::to_string(line) + ": " : "") + output.error, "ERROR");
+
+    if (options.json)
+    {
+        nlohmann::json result_json = nlohmann::json::array();
+
+        for (size_t i = 0; i < output.results.size(); i++)
+        {
+            const SearchResult &result = output.results[i];
+            result_json.push_back({
+                {"rank", i + 1},
+                {"document", result.getDocumentPath().string()},
+                {"score", result.relevance_score},
+                {"occurrences", result.getOccurrenceCount()}
+            });
+        }
+
+        nlohmann::json query_json = {{"query", query}, {"results", result_json}, {"more", output.more}};
+        if (line)
+            query_json["line"] = line;
+        if (!output.error.empty())
+            query_json["error"] = output.error;
+
+        std::cout << query_json.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << '\n';
+        return;
+    }
+
+    for (size_t i = 0; i < output.results.size(); i++)
+    {
+        const SearchResult &result = output.results[i];
+
+        if (line)
+            std::cout << line << '\t';
+
+        std::cout << i + 1 << '\t' << result.relevance_score << '\t' << result.getOccurrenceCount()
+                  << '\t' << result.getDocumentPath().string() << '\n';
+    }
+}
+
+/**
+ * @brief Searches each line of standard input as a query and writes the results
+ * in order of lines.
+ *
+ * Lines are read in batches that are searched on a pool of threads. Each query
+ * is scored on a single thread since the queries of batch already keep all
+ * threads busy.
+ */
+void runCliBatch(SearchEngine &engine, const CliOptions &options)
+{
+    size_t thread_count = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    ThreadPool pool(thread_count - 1);
+    engine.query_threads = 1;
+
+    std::vector<std::string> queries;
+    std::vector<CliResults> outputs;
+    size_t line = 0;
+    bool done = false;
+
+    while (!done)
+    {
+        queries.clear();
+
+        std::string query;
+        while (queries.size() < CLI_BATCH_SIZE)
+        {
+            if (!std::getline(std::cin, query))
+            {
+                done = true;
+                break;
+            }
+
+            queries.push_back(query);
+        }
+
+        outputs.assign(queries.size(), CliResults());
+        pool.run(queries.size(), [&](size_t i) {
+            if (queries[i].find_first_not_of(" \t\r") != std::string::npos)
+                outputs[i] = runCliQuery(engine, options, queries[i]);
+        });
+
+        for (size_t i = 0; i < queries.size(); i++)
+        {
+            line++;
+            if (queries[i].find_first_not_of(" \t\r") != std::string::npos)
+                printCliResults(options, queries[i], outputs[i], line);
+        }
+
+        std::cout.flush();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // Standard output only has the results; messages are written to standard error.
+    log_stream = &std::cerr;
+    std::ios::sync_with_stdio(false);
+
+    CliOptions options;
+
+    try
+    {
+        options = parseCliOptions(argc, argv);
+    }
+    catch (const std::string &message)
+    {
+        std::cerr << message << "\n\n" << CLI_USAGE;
+        return 2;
+    }
+
+    try
+    {
+        SearchEngine engine(options.corpus);
+
+        if (options.command == "index")
+        {
+            // Documents that did not change are imported from the loaded index.
+            if (!options.full && checkFileExists(INDEX_SEGMENT_FILENAME))
+                engine.indexCorpusDirectory(true);
+
+            engine.incremental_indexing = !options.full;
+            engine.indexCorpusDirectory(false);
+            return engine.getIndexSize() ? 0 : 1;
+        }
+
+        engine.indexCorpusDirectory();
+
+        if (options.command == "query")
+        {
+            CliResults output = runCliQuery(engine, options, options.query);
+            printCliResults(options, options.query, output, 0);
+            return output.error.empty() ? 0 : 1;
+        }
+
+        runCliBatch(engine, options);
+    }
+    catch (const char* message)
+    {
+        log(message, "ERROR");
+        return 1;
+    }
+    catch (const std::exception &e)
+    {
+        log(e.what(), "ERROR");
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,925 @@
+/**
+ *  Search100 Daemon
+ *
+ * HTTP server that loads the indexes once and serves search queries over a
+ * local socket, e.g. for other programs that search on every request.
+ *
+ * Connections are handled by a single event loop using epoll; queries are
+ * searched by a fixed pool of worker threads so that a slow query does not
+ * hold up the other connections. Only Linux is supported.
+ *
+ * Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025
+ *
+ * */
+
+#ifndef _SEARCH100_DAEMON
+#define _SEARCH100_DAEMON
+
+#ifndef __linux__
+#error "search100d uses epoll and is only supported on Linux."
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "engine.cpp"
+#include "http.cpp"
+#include "utils.cpp"
+
+/**
+ * @brief The maximum size of request line and headers of a request. Connections
+ * that send larger requests are closed.
+ */
+const size_t DAEMON_MAX_REQUEST_SIZE = 16 * 1024;
+
+/**
+ * @brief The number of latencies of most recent searches kept for statistics.
+ */
+const size_t DAEMON_LATENCY_SAMPLES = 8192;
+
+/**
+ * @brief The maximum number of results of a single search.
+ */
+const size_t DAEMON_MAX_RESULTS = 1000;
+
+const std::string DAEMON_USAGE =
+    "Usage: search100d [options]\n"
+    "\n"
+    "Options:\n"
+    "  --corpus <dir>     The corpus directory. (default: corpus/)\n"
+    "  --bind <address>   The IPv4 address to listen on. (default: 127.0.0.1)\n"
+    "  --port <port>      The port to listen on. (default: 8100)\n"
+    "  --threads <n>      The number of worker threads that search queries. (default: one per core)\n"
+    "\n"
+    "Endpoints:\n"
+    "  GET  /search?q=<query>[&limit=10][&strategy=and|or][&ranking=tfidf|bm25]\n"
+    "  GET  /stats\n"
+    "  GET  /health\n"
+    "  POST /reindex\n";
+
+/* The eventfd that wakes up the event loop. Written by signal handler on shutdown. */
+int daemon_wake_fd = -1;
+volatile std::sig_atomic_t daemon_stopping = 0;
+
+void handleDaemonSignal(int)
+{
+    daemon_stopping = 1;
+
+    uint64_t value = 1;
+    if (write(daemon_wake_fd, &value, sizeof(value)) < 0) {}
+}
+
+/**
+ * @brief The options of daemon, see DAEMON_USAGE.
+ */
+class DaemonOptions
+{
+    public:
+
+    std::string corpus = "corpus/";
+    std::string bind = "127.0.0.1";
+    uint16_t port = 8100;
+    size_t threads = 0;
+};
+
+/**
+ * @brief Builds an HTTP response with an error message as body.
+ */
+std::string buildHttpError(int status, const std::string &message, bool keep_alive)
+{
+    nlohmann::json body = {{"error", message}};
+    return buildHttpResponse(status, body.dump(), keep_alive);
+}
+
+/**
+ * @brief Keeps the latencies of recent searches to report their percentiles.
+ *
+ * This class is safe to use from multiple threads.
+ */
+class LatencyStats
+{
+    std::vector<double> samples;
+    size_t next = 0;
+    uint64_t count = 0;
+    mutable std::mutex mutex;
+
+    public:
+
+    /**
+     * @brief Records the latency of a search, in milliseconds.
+     */
+    void record(double latency_ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (samples.size() < DAEMON_LATENCY_SAMPLES)
+            samples.push_back(latency_ms);
+        else
+            samples[next] = latency_ms;
+
+        next = (next + 1) % DAEMON_LATENCY_SAMPLES;
+        count++;
+    }
+
+    /**
+     * @brief The number of searches recorded.
+     */
+    uint64_t getCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+    /**
+     * @brief Computes a percentile of recent latencies.
+     *
+     * @param percentile: The percentile, between 0 and 100.
+     *
+     * @returns double - the latency in milliseconds, or zero if no searches are recorded.
+     */
+    double getPercentile(double percentile) const
+    {
+        std::vector<double> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sorted = samples;
+        }
+
+        if (sorted.empty())
+            return 0;
+
+        size_t rank = std::min(sorted.size() - 1, (size_t) (percentile / 100 * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+};
+
+/**
+ * @brief Fixed set of threads that run tasks in order they are submitted.
+ */
+class WorkerPool
+{
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    public:
+
+    WorkerPool(size_t thread_count)
+    {
+        for (size_t i = 0; i < thread_count; i++)
+            threads.emplace_back(&WorkerPool::work, this);
+    }
+
+    /**
+     * @brief Finishes the submitted tasks and joins the threads.
+     */
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        available.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    /**
+     * @brief Submits a task to run on one of threads.
+     */
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+
+        available.notify_one();
+    }
+};
+
+/**
+ * @brief HTTP server that serves search queries of a search engine.
+ *
+ * A connection handles one request at a time: requests that a client sends
+ * before the response of previous one (pipelining) are buffered and handled
+ * in order. Connections are kept alive unless client asks otherwise so that
+ * clients may reuse them for many requests.
+ */
+class SearchServer
+{
+    /**
+     * @brief The state of a client connection.
+     */
+    class Connection
+    {
+        public:
+
+        int fd = -1;
+
+        /* Distinguishes connections that reused the same file descriptor. */
+        uint64_t id = 0;
+
+        std::string input;
+        std::string output;
+        size_t output_offset = 0;
+
+        /* Whether a request is being handled by a worker. */
+        bool busy = false;
+
+        /* Whether connection is closed once output is written. */
+        bool closing = false;
+
+        /* Whether client shut down its end. Requests already received are still handled. */
+        bool peer_closed = false;
+
+        /* Whether writing waits for the socket to become writable. */
+        bool waiting_writable = false;
+    };
+
+    /**
+     * @brief A response computed by a worker.
+     */
+    class Completion
+    {
+        public:
+
+        int fd;
+        uint64_t id;
+        std::string response;
+    };
+
+    SearchEngine &engine;
+    std::unique_ptr<WorkerPool> workers;
+    LatencyStats latencies;
+
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+
+    std::unordered_map<int, Connection> connections;
+    uint64_t next_connection_id = 0;
+
+    std::vector<Completion> completions;
+    std::mutex completions_mutex;
+
+    std::atomic<uint64_t> request_count{0};
+
+    void watch(int fd, uint32_t events, int operation)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+
+        if (epoll_ctl(epoll_fd, operation, fd, &event) < 0)
+            throw std::runtime_error(std::string("epoll_ctl failed: ") + std::strerror(errno));
+    }
+
+    void closeConnection(Connection &connection)
+    {
+        int fd = connection.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(fd);
+    }
+
+    void acceptConnections()
+    {
+        while (true)
+        {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    log(std::string("Could not accept connection: ") + std::strerror(errno), "WARNING");
+
+                return;
+            }
+
+            int enabled = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+
+            Connection &connection = connections[fd];
+            connection.fd = fd;
+            connection.id = next_connection_id++;
+            watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+        }
+    }
+
+    /**
+     * @brief Writes as much of pending output as socket accepts. Returns false if
+     * connection was closed.
+     */
+    bool flushConnection(Connection &connection)
+    {
+        while (connection.output_offset < connection.output.size())
+        {
+            ssize_t written = send(connection.fd, connection.output.data() + connection.output_offset,
+                                   connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    if (!connection.waiting_writable)
+                    {
+                        watch(connection.fd, connection.peer_closed ? (uint32_t) EPOLLOUT
+                                                                    : (uint32_t) (EPOLLIN | EPOLLOUT | EPOLLRDHUP),
+                              EPOLL_CTL_MOD);
+                        connection.waiting_writable = true;
+                    }
+
+                    return true;
+                }
+
+                closeConnection(connection);
+                return false;
+            }
+
+            connection.output_offset += written;
+        }
+
+        connection.output.clear();
+        connection.output_offset = 0;
+
+        if (connection.waiting_writable)
+        {
+            watch(connection.fd, connection.peer_closed ? 0u : (uint32_t) (EPOLLIN | EPOLLRDHUP), EPOLL_CTL_MOD);
+            connection.waiting_writable = false;
+        }
+
+        if (connection.closing)
+        {
+            closeConnection(connection);
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Reads available input of connection. Returns false if client closed
+     * its end of connection.
+     */
+    bool readConnection(Connection &connection)
+    {
+        char buffer[16 * 1024];
+
+        while (true)
+        {
+            ssize_t count = recv(connection.fd, buffer, sizeof(buffer), 0);
+
+            if (count > 0)
+            {
+                connection.input.append(buffer, count);
+                if (connection.input.size() > DAEMON_MAX_REQUEST_SIZE * 4)
+                    return false;
+
+                continue;
+            }
+
+            if (count < 0 && errno == EINTR)
+                continue;
+
+            if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return true;
+
+            return false;
+        }
+    }
+
+    /**
+     * @brief Handles the next buffered request of connection, if it is complete and
+     * no other request of connection is being handled. Returns false if connection
+     * was closed.
+     */
+    bool handleInput(Connection &connection)
+    {
+        while (!connection.busy && !connection.closing && connection.output.empty())
+        {
+            size_t head_end = connection.input.find("\r\n\r\n");
+            if (head_end == std::string::npos || head_end > DAEMON_MAX_REQUEST_SIZE)
+            {
+                if (head_end == std::string::npos && connection.input.size() <= DAEMON_MAX_REQUEST_SIZE)
+                    return closeIfDone(connection);
+
+                connection.output = buildHttpError(431, "Request is too large.", false);
+                connection.closing = true;
+                return flushConnection(connection);
+            }
+
+            HttpRequest request;
+            size_t content_length;
+
+            if (!parseHttpRequest(connection.input.substr(0, head_end), request, content_length))
+            {
+                connection.output = buildHttpError(400, "Malformed request.", false);
+                connection.closing = true;
+                return flushConnection(connection);
+            }
+
+            // Request bodies are not used by any endpoint so they are discarded.
+            if (content_length > DAEMON_MAX_REQUEST_SIZE)
+            {
+                connection.output = buildHttpError(431, "Request is too large.", false);
+                connection.closing = true;
+                return flushConnection(connection);
+            }
+
+            if (connection.input.size() < head_end + 4 + content_length)
+                return closeIfDone(connection);
+
+            connection.input.erase(0, head_end + 4 + content_length);
+            connection.closing = !request.keep_alive;
+            request_count++;
+
+            if (request.path == "/search" && request.method == "GET")
+            {
+                dispatchSearch(connection, std::move(request));
+                return true;
+            }
+
+            connection.output = handleRequest(request);
+            if (!flushConnection(connection))
+                return false;
+        }
+
+        return closeIfDone(connection);
+    }
+
+    /**
+     * @brief Closes connection if client shut down its end and all requests it sent
+     * are handled. Returns false if connection was closed.
+     */
+    bool closeIfDone(Connection &connection)
+    {
+        if (!connection.peer_closed || connection.busy || !connection.output.empty())
+            return true;
+
+        closeConnection(connection);
+        return false;
+    }
+
+    /**
+     * @brief Handles the requests that are cheap enough to handle on event loop.
+     */
+    std::string handleRequest(const HttpRequest &request)
+    {
+        bool keep_alive = request.keep_alive;
+
+        if (request.path == "/health")
+        {
+            if (request.method != "GET")
+                return buildHttpError(405, "Method not allowed.", keep_alive);
+
+            nlohmann::json body = {{"status", "ok"}, {"documents", engine.getIndexSize()},
+                                   {"indexing", engine.isIndexing()}};
+            return buildHttpResponse(200, body.dump(), keep_alive);
+        }
+
+        if (request.path == "/stats")
+        {
+            if (request.method != "GET")
+                return buildHttpError(405, "Method not allowed.", keep_alive);
+
+            nlohmann::json body = {
+                {"requests", request_count.load()},
+                {"searches", latencies.getCount()},
+                {"connections", connections.size()},
+                {"latency_ms", {{"p50", latencies.getPercentile(50)}, {"p90", latencies.getPercentile(90)},
+                                {"p99", latencies.getPercentile(99)}}},
+                {"result_cache", {{"hits", engine.getResultCache().getHits()},
+                                  {"misses", engine.getResultCache().getMisses()},
+                                  {"entries", engine.getResultCache().getCount()}}}
+            };
+            return buildHttpResponse(200, body.dump(), keep_alive);
+        }
+
+        if (request.path == "/reindex")
+        {
+            if (request.method != "POST")
+                return buildHttpError(405, "Method not allowed.", keep_alive);
+
+            // Queries keep being served from the current indexes while reindexing.
+            if (!engine.startIndexing(false))
+                return buildHttpError(409, "Documents are already being indexed.", keep_alive);
+
+            return buildHttpResponse(202, "{\"status\":\"indexing\"}", keep_alive);
+        }
+
+        if (request.path == "/search")
+            return buildHttpError(405, "Method not allowed.", keep_alive);
+
+        return buildHttpError(404, "Not found.", keep_alive);
+    }
+
+    /**
+     * @brief Searches the query of a request on a worker thread. The response is
+     * written to connection once the event loop is woken up.
+     */
+    void dispatchSearch(Connection &connection, HttpRequest request)
+    {
+        connection.busy = true;
+
+        int fd = connection.fd;
+        uint64_t id = connection.id;
+        auto started = std::chrono::steady_clock::now();
+
+        workers->submit([this, fd, id, started, request = std::move(request)]()
+        {
+            std::string response = handleSearch(request);
+
+            double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+            latencies.record(latency);
+
+            {
+                std::lock_guard<std::mutex> lock(completions_mutex);
+                completions.push_back(Completion{fd, id, std::move(response)});
+            }
+
+            uint64_t value = 1;
+            if (write(wake_fd, &value, sizeof(value)) < 0) {}
+        });
+    }
+
+    /**
+     * @brief Searches the query of a /search request. Runs on a worker thread.
+     */
+    std::string handleSearch(const HttpRequest &request)
+    {
+        bool keep_alive = request.keep_alive;
+
+        auto param = [&request](const std::string &name, const std::string &fallback)
+        {
+            auto it = request.params.find(name);
+            return it == request.params.end() ? fallback : it->second;
+        };
+
+        std::string query = param("q", "");
+        std::string strategy = param("strategy", "and");
+        std::string ranking_name = param("ranking", "tfidf");
+        std::string limit_value = param("limit", "10");
+
+        if (query.find_first_not_of(" \t") == std::string::npos)
+            return buildHttpError(400, "Parameter q is required.", keep_alive);
+        if (strategy != "and" && strategy != "or")
+            return buildHttpError(400, "Parameter strategy must be and or or.", keep_alive);
+        if (ranking_name != "tfidf" && ranking_name != "bm25")
+            return buildHttpError(400, "Parameter ranking must be tfidf or bm25.", keep_alive);
+        if (limit_value.empty() || limit_value.size() > 9
+            || !std::all_of(limit_value.begin(), limit_value.end(), [](unsigned char c) { return std::isdigit(c); }))
+            return buildHttpError(400, "Parameter limit must be a non-negative integer.", keep_alive);
+
+        size_t limit = std::stoul(limit_value);
+        if (limit == 0 || limit > DAEMON_MAX_RESULTS)
+            limit = DAEMON_MAX_RESULTS;
+
+        RankingFunction ranking = ranking_name == "bm25" ? RankingFunction::BM25 : RankingFunction::TF_IDF;
+
+        try
+        {
+            std::vector<SearchResult> results = engine.search(query, strategy == "and", limit, ranking);
+            nlohmann::json results_json = nlohmann::json::array();
+
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                results_json.push_back({
+                    {"rank", i + 1},
+                    {"document", results[i].getDocumentPath().string()},
+                    {"score", results[i].relevance_score},
+                    {"occurrences", results[i].getOccurrenceCount()}
+                });
+            }
+
+            nlohmann::json body = {{"query", query}, {"results", results_json}};
+            return buildHttpResponse(200, body.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace), keep_alive);
+        }
+        catch (const char* message)
+        {
+            return buildHttpError(500, message, keep_alive);
+        }
+        catch (const std::exception &e)
+        {
+            return buildHttpError(500, e.what(), keep_alive);
+        }
+    }
+
+    /**
+     * @brief Writes the responses computed by workers to their connections.
+     */
+    void writeCompletions()
+    {
+        uint64_t value;
+        if (read(wake_fd, &value, sizeof(value)) < 0) {}
+
+        std::vector<Completion> ready;
+        {
+            std::lock_guard<std::mutex> lock(completions_mutex);
+            ready.swap(completions);
+        }
+
+        for (Completion &completion : ready)
+        {
+            auto it = connections.find(completion.fd);
+            if (it == connections.end() || it->second.id != completion.id)
+                continue;
+
+            Connection &connection = it->second;
+            connection.busy = false;
+            connection.output = std::move(completion.response);
+
+            if (flushConnection(connection))
+                handleInput(connection);
+        }
+    }
+
+    public:
+
+    /**
+     * @param engine_inst: The search engine to serve. Its indexes should be loaded.
+     * @param thread_count: The number of worker threads.
+     */
+    SearchServer(SearchEngine &engine_inst, size_t thread_count)
+        : engine(engine_inst)
+    {
+        workers = std::make_unique<WorkerPool>(thread_count);
+    }
+
+    ~SearchServer()
+    {
+        // Workers use the event loop, so they are stopped before it is closed.
+        workers.reset();
+
+        for (auto &[fd, connection] : connections)
+            close(fd);
+
+        if (listen_fd >= 0)
+            close(listen_fd);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        if (wake_fd >= 0)
+            close(wake_fd);
+    }
+
+    /**
+     * @brief Starts listening for connections.
+     *
+     * @param address: The IPv4 address to listen on.
+     * @param port: The port to listen on. If zero, a free port is chosen.
+     *
+     * @returns uint16_t - the port listened on.
+     */
+    uint16_t listen(const std::string &address, uint16_t port)
+    {
+        sockaddr_in socket_address{};
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_port = htons(port);
+
+        if (inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1)
+            throw std::runtime_error("Invalid address to listen on: " + address);
+
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int enabled = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+
+        if (bind(listen_fd, (sockaddr*) &socket_address, sizeof(socket_address)) < 0
+            || ::listen(listen_fd, SOMAXCONN) < 0)
+            throw std::runtime_error("Could not listen on " + address + ":" + std::to_string(port) + ": " + std::strerror(errno));
+
+        socklen_t length = sizeof(socket_address);
+        getsockname(listen_fd, (sockaddr*) &socket_address, &length);
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || wake_fd < 0)
+            throw std::runtime_error(std::string("Could not create event loop: ") + std::strerror(errno));
+
+        watch(listen_fd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wake_fd, EPOLLIN, EPOLL_CTL_ADD);
+
+        return ntohs(socket_address.sin_port);
+    }
+
+    /**
+     * @brief The eventfd that wakes up the event loop, e.g. to stop it.
+     */
+    int getWakeFd() const
+    {
+        return wake_fd;
+    }
+
+    /**
+     * @brief Runs the event loop until `stopping` is set and event loop is woken up.
+     */
+    void run(volatile std::sig_atomic_t &stopping)
+    {
+        std::vector<epoll_event> events(256);
+
+        while (!stopping)
+        {
+            int count = epoll_wait(epoll_fd, events.data(), events.size(), -1);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                throw std::runtime_error(std::string("epoll_wait failed: ") + std::strerror(errno));
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                int fd = events[i].data.fd;
+                uint32_t flags = events[i].events;
+
+                if (fd == listen_fd)
+                {
+                    acceptConnections();
+                    continue;
+                }
+
+                if (fd == wake_fd)
+                {
+                    writeCompletions();
+                    continue;
+                }
+
+                auto it = connections.find(fd);
+                if (it == connections.end())
+                    continue;
+
+                Connection &connection = it->second;
+
+                // Once both directions are shut down, no response can be written.
+                if (flags & (EPOLLERR | EPOLLHUP))
+                {
+                    closeConnection(connection);
+                    continue;
+                }
+
+                // Requests pipelined behind a response are handled once it is written.
+                if ((flags & EPOLLOUT) && (!flushConnection(connection) || !handleInput(connection)))
+                    continue;
+
+                if (flags & (EPOLLIN | EPOLLRDHUP))
+                {
+                    // Once client closed its end, the requests it sent before are still
+                    // handled and their responses written before connection is closed.
+                    if (!readConnection(connection))
+                    {
+                        connection.peer_closed = true;
+                        watch(connection.fd, connection.waiting_writable ? (uint32_t) EPOLLOUT : 0u, EPOLL_CTL_MOD);
+                    }
+
+                    handleInput(connection);
+                }
+            }
+        }
+    }
+};
+
+/**
+ * @brief Parses command line arguments.
+ *
+ * Throws a string describing the error if arguments are invalid.
+ */
+DaemonOptions parseDaemonOptions(int argc, char* argv[])
+{
+    DaemonOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            throw "Option " + arg + " expects a value.";
+
+        std::string value = argv[++i];
+        bool numeric = !value.empty() && value.size() <= 9 && std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); });
+
+        if (arg == "--corpus")
+        {
+            options.corpus = value;
+            if (options.corpus.back() != '/' && options.corpus.back() != '\\')
+                options.corpus += '/';
+        }
+        else if (arg == "--bind")
+            options.bind = value;
+        else if (arg == "--port")
+        {
+            if (!numeric || std::stoul(value) > 65535)
+                throw "Invalid port: " + value;
+
+            options.port = std::stoul(value);
+        }
+        else if (arg == "--threads")
+        {
+            if (!numeric)
+                throw std::string("Option --threads expects a non-negative integer.");
+
+            options.threads = std::stoul(value);
+        }
+        else
+            throw "Unknown option: " + arg;
+    }
+
+    return options;
+}
+
+int main(int argc, char* argv[])
+{
+    DaemonOptions options;
+
+    try
+    {
+        options = parseDaemonOptions(argc, argv);
+    }
+    catch (const std::string &message)
+    {
+        std::cerr << message << "\n\n" << DAEMON_USAGE;
+        return 2;
+    }
+
+    try
+    {
+        SearchEngine engine(options.corpus);
+        engine.indexCorpusDirectory();
+
+        size_t thread_count = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        SearchServer server(engine, thread_count);
+        uint16_t port = server.listen(options.bind, options.port);
+
+        daemon_wake_fd = server.getWakeFd();
+        std::signal(SIGINT, handleDaemonSignal);
+        std::signal(SIGTERM, handleDaemonSignal);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        log("Serving " + std::to_string(engine.getIndexSize()) + " documents on http://" + options.bind + ":"
+            + std::to_string(port) + " with " + std::to_string(thread_count) + " worker threads.");
+
+        server.run(daemon_stopping);
+        log("Shutting down...");
+    }
+    catch (const char* message)
+    {
+        log(message, "ERROR");
+        return 1;
+    }
+    catch (const std::exception &e)
+    {
+        log(e.what(), "ERROR");
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif
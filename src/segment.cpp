@@ -0,0 +1,1374 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_SEGMENT
+#define _SEARCH100_SEGMENT
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "inverted_index.cpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SEARCH100_USE_SSE2
+    #include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * On-disk index segment.
+ *
+ * A segment is a single binary file holding the complete index of the corpus. It
+ * is laid out so that it can be memory mapped and queried in place, without parsing
+ * or deserializing anything up front. Pages of the file are only read by the OS when
+ * a query actually touches them.
+ *
+ * All integers are stored in host byte order, so segments are not portable across
+ * machines of different endianness. Every section (except postings, which is a
+ * byte stream) begins at an 8 byte aligned offset so the entries can be accessed
+ * directly through the structs below. The file is laid out as follows:
+ *
+ * [header] [documents] [lengths] [terms] [surfaces] [blocks] [postings] [positions] [strings]
+ *
+ * - documents: one SegmentDocument per document, indexed by document ID. This also
+ *   serves as the manifest used to detect changed files on reindexing.
+ * - lengths: one SegmentDocumentLength per document, indexed by document ID. These
+ *   are kept apart from documents so that scoring reads them from a compact array.
+ * - terms: one SegmentTerm per stemmed term, sorted by term string (term dictionary).
+ *   The position of a term in this section is its term ID. The IDF of each term is
+ *   computed when segment is written.
+ * - surfaces: one SegmentSurface per distinct original (unstemmed) word, sorted by
+ *   string (surface form dictionary). The position of a word is its surface ID.
+ * - blocks: for each term, one SegmentPostingBlock per POSTING_BLOCK_SIZE postings.
+ *   The blocks are used to skip over postings without decoding them, and their
+ *   largest term frequencies and occurrence counts and smallest document lengths
+ *   bound the scores of postings they contain.
+ * - postings: for each block, the gaps between document IDs followed by occurrence
+ *   counts, encoded as variable length integers.
+ * - positions: for each posting, SegmentPosition entries (the occurrences) in order
+ *   they occur in document. These reference original words by surface ID so each
+ *   word is stored only once.
+ * - strings: raw bytes of terms, document paths and original words.
+ */
+
+const char SEGMENT_MAGIC[8] = {'S', '1', '0', '0', 'I', 'D', 'X', '\0'};
+
+/**
+ * @brief The version of segment format written by this build.
+ *
+ * Segments with any other version are rejected on load and the corpus is
+ * reindexed. This must be bumped whenever the layout below, or the way
+ * documents are split into terms, changes.
+ */
+const uint32_t SEGMENT_VERSION = 9;
+
+/**
+ * @brief The maximum number of postings in a posting block.
+ */
+const uint32_t POSTING_BLOCK_SIZE = 128;
+
+struct SegmentHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t document_count;
+    uint32_t term_count;
+    uint32_t surface_count;
+    uint64_t block_count;
+    uint64_t postings_size;
+    uint64_t position_count;
+    uint64_t token_count;
+    uint64_t documents_offset;
+    uint64_t lengths_offset;
+    uint64_t terms_offset;
+    uint64_t surfaces_offset;
+    uint64_t blocks_offset;
+    uint64_t postings_offset;
+    uint64_t positions_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+};
+
+struct SegmentDocument
+{
+    /* Offset of path relative to strings section. */
+    uint64_t path_offset;
+    uint32_t path_length;
+    uint32_t reserved;
+
+    /* Size, modification time and content hash of file when it was indexed. */
+    uint64_t file_size;
+    int64_t modified_time;
+    uint64_t content_hash;
+};
+
+struct SegmentDocumentLength
+{
+    /* Number of distinct terms and of indexed words in document. */
+    uint32_t term_count;
+    uint32_t token_count;
+};
+
+struct SegmentTerm
+{
+    /* Offset of term relative to strings section. */
+    uint64_t string_offset;
+
+    /* Index of first block of this term in blocks section. */
+    uint64_t blocks_start;
+    uint32_t string_length;
+    uint32_t document_frequency;
+
+    /* Inverse document frequency of this term. */
+    double idf;
+
+    /* Largest term frequency and occurrence count of this term in any document,
+       and the fewest words in any document containing it. */
+    float max_term_frequency;
+    uint32_t max_occurrence_count;
+    uint32_t min_token_count;
+    uint32_t reserved;
+};
+
+struct SegmentSurface
+{
+    /* Offset of word relative to strings section. */
+    uint64_t string_offset;
+    uint32_t string_length;
+    uint32_t reserved;
+};
+
+struct SegmentPostingBlock
+{
+    /* Offset of encoded postings relative to postings section. */
+    uint64_t data_offset;
+
+    /* Index of first position of this block in positions section. */
+    uint64_t positions_start;
+    uint32_t first_document_id;
+    uint32_t last_document_id;
+
+    /* Largest term frequency and occurrence count of any posting in this block,
+       and the fewest words in any of its documents. */
+    float max_term_frequency;
+    uint32_t max_occurrence_count;
+    uint32_t min_token_count;
+    uint32_t reserved;
+};
+
+struct SegmentPosition
+{
+    /* ID of original word in surface form dictionary. */
+    uint32_t surface_id;
+    uint32_t line;
+    uint32_t index;
+
+    /* Ordinal of word among all words of document. */
+    uint32_t position;
+};
+
+/**
+ * @brief A decoded posting.
+ *
+ * Postings are not stored in this form in segment; these are produced by
+ * PostingCursor when a posting block is decoded.
+ */
+struct SegmentPosting
+{
+    /* Index of first position of this posting in positions section. */
+    uint64_t positions_start;
+    uint32_t document_id;
+    uint32_t occurrence_count;
+};
+
+
+/**
+ * @brief Appends an unsigned integer in variable length (LEB128) encoding.
+ *
+ * Each byte stores 7 bits of value with highest bit set if more bytes follow,
+ * so the small gaps between document IDs usually take a single byte.
+ */
+void encodeVarint(std::string &out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back((char)value);
+}
+
+/**
+ * @brief Gets the number of bytes that encodeVarint() encodes a value in.
+ */
+uint32_t varintLength(uint32_t value)
+{
+    uint32_t length = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        length++;
+    }
+
+    return length;
+}
+
+/**
+ * @brief Decodes an unsigned integer written by encodeVarint().
+ *
+ * @param data: Pointer to encoded integer.
+ * @param end: Pointer past the end of readable data.
+ * @param value: Set to decoded value.
+ *
+ * @returns pointer past the decoded integer.
+ */
+const uint8_t* decodeVarint(const uint8_t* data, const uint8_t* end, uint32_t &value)
+{
+    value = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (data == end)
+            throw "Index segment is corrupted: postings out of bounds.";
+
+        uint8_t byte = *data++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            return data;
+    }
+
+    throw "Index segment is corrupted: invalid posting.";
+}
+
+/**
+ * @brief Gets the term frequency bound stored in term and block entries.
+ *
+ * Term frequency is the occurrence count of a term in a document divided by
+ * the number of distinct terms in that document. It is rounded up when narrowed
+ * to float so the stored value is never less than the exact one.
+ */
+float termFrequencyBound(uint32_t occurrence_count, uint32_t term_count)
+{
+    double exact = (double)occurrence_count / (double)term_count;
+    float bound = (float)exact;
+
+    if ((double)bound < exact)
+        bound = std::nextafter(bound, INFINITY);
+
+    return bound;
+}
+
+
+/**
+ * @brief Read-only memory mapping of a file.
+ */
+class MappedFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    #ifdef _WIN32
+        HANDLE file_handle = INVALID_HANDLE_VALUE;
+        HANDLE mapping_handle = NULL;
+    #endif
+
+    public:
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /**
+     * @brief Maps the given file in memory.
+     *
+     * @param filename: The path of file to map.
+     *
+     * @returns bool - true if file was mapped successfully.
+     */
+    bool open(const std::string &filename)
+    {
+        close();
+
+        #ifdef _WIN32
+
+            file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file_handle == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+            {
+                close();
+                return false;
+            }
+
+            mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping_handle == NULL)
+            {
+                close();
+                return false;
+            }
+
+            data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+            if (data == NULL)
+            {
+                close();
+                return false;
+            }
+
+            size = (size_t)file_size.QuadPart;
+
+        #else
+
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);  // the mapping stays valid after descriptor is closed
+
+            if (addr == MAP_FAILED)
+                return false;
+
+            data = (const char*)addr;
+            size = st.st_size;
+
+        #endif
+
+        return true;
+    }
+
+    /**
+     * @brief Unmaps the file, if mapped.
+     */
+    void close()
+    {
+        #ifdef _WIN32
+
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping_handle != NULL)
+                CloseHandle(mapping_handle);
+            if (file_handle != INVALID_HANDLE_VALUE)
+                CloseHandle(file_handle);
+
+            mapping_handle = NULL;
+            file_handle = INVALID_HANDLE_VALUE;
+
+        #else
+
+            if (data)
+                munmap((void*)data, size);
+
+        #endif
+
+        data = nullptr;
+        size = 0;
+    }
+
+    const char* getData() const
+    {
+        return data;
+    }
+
+    size_t getSize() const
+    {
+        return size;
+    }
+};
+
+
+/**
+ * @brief A memory mapped index segment that queries are served from.
+ *
+ * Opening a segment only validates the header; the term dictionary, postings
+ * and positions are accessed in place when queries are performed.
+ */
+class IndexSegment
+{
+    MappedFile file;
+    const SegmentHeader* header = nullptr;
+    const SegmentDocument* documents = nullptr;
+    const SegmentDocumentLength* lengths = nullptr;
+    const SegmentTerm* terms = nullptr;
+    const SegmentSurface* surfaces = nullptr;
+    const SegmentPostingBlock* blocks = nullptr;
+    const uint8_t* postings = nullptr;
+    const SegmentPosition* positions = nullptr;
+    const char* strings = nullptr;
+    uint64_t strings_size = 0;
+
+    /**
+     * @brief Checks that `count` entries of `entry_size` at `offset` fit in file.
+     */
+    bool sectionFits(uint64_t offset, uint64_t count, uint64_t entry_size, uint64_t alignment = 8)
+    {
+        uint64_t size = file.getSize();
+        if ((offset % alignment) || offset > size)
+            return false;
+
+        return count <= (size - offset) / entry_size;
+    }
+
+    std::string_view getString(uint64_t offset, uint32_t length) const
+    {
+        if (offset > strings_size || length > strings_size - offset)
+            throw "Index segment is corrupted: string out of bounds.";
+
+        return std::string_view(strings + offset, length);
+    }
+
+    public:
+
+    /**
+     * @brief Maps the segment file and validates its header.
+     *
+     * @param filename: The path of segment file.
+     *
+     * @returns bool - true if segment is valid and was loaded. False if the file
+     * does not exist, has an incompatible version, or is malformed.
+     */
+    bool open(const std::string &filename)
+    {
+        close();
+
+        if (!file.open(filename))
+            return false;
+
+        if (file.getSize() < sizeof(SegmentHeader))
+        {
+            close();
+            return false;
+        }
+
+        const char* base = file.getData();
+        const SegmentHeader* hdr = (const SegmentHeader*)base;
+
+        bool valid = (std::memcmp(hdr->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0)
+            && (hdr->version == SEGMENT_VERSION)
+            && (hdr->file_size == file.getSize())
+            && sectionFits(hdr->documents_offset, hdr->document_count, sizeof(SegmentDocument))
+            && sectionFits(hdr->lengths_offset, hdr->document_count, sizeof(SegmentDocumentLength))
+            && sectionFits(hdr->terms_offset, hdr->term_count, sizeof(SegmentTerm))
+            && sectionFits(hdr->surfaces_offset, hdr->surface_count, sizeof(SegmentSurface))
+            && sectionFits(hdr->blocks_offset, hdr->block_count, sizeof(SegmentPostingBlock))
+            && sectionFits(hdr->postings_offset, hdr->postings_size, 1, 1)
+            && sectionFits(hdr->positions_offset, hdr->position_count, sizeof(SegmentPosition))
+            && sectionFits(hdr->strings_offset, 0, 1);
+
+        if (!valid)
+        {
+            close();
+            return false;
+        }
+
+        header = hdr;
+        documents = (const SegmentDocument*)(base + hdr->documents_offset);
+        lengths = (const SegmentDocumentLength*)(base + hdr->lengths_offset);
+        terms = (const SegmentTerm*)(base + hdr->terms_offset);
+        surfaces = (const SegmentSurface*)(base + hdr->surfaces_offset);
+        blocks = (const SegmentPostingBlock*)(base + hdr->blocks_offset);
+        postings = (const uint8_t*)(base + hdr->postings_offset);
+        positions = (const SegmentPosition*)(base + hdr->positions_offset);
+        strings = base + hdr->strings_offset;
+        strings_size = file.getSize() - hdr->strings_offset;
+
+        return true;
+    }
+
+    /**
+     * @brief Unmaps the segment.
+     */
+    void close()
+    {
+        file.close();
+        header = nullptr;
+        documents = nullptr;
+        lengths = nullptr;
+        terms = nullptr;
+        surfaces = nullptr;
+        blocks = nullptr;
+        postings = nullptr;
+        positions = nullptr;
+        strings = nullptr;
+        strings_size = 0;
+    }
+
+    bool isOpen() const
+    {
+        return header != nullptr;
+    }
+
+    int documentCount() const
+    {
+        return header ? header->document_count : 0;
+    }
+
+    /**
+     * @brief Checks whether the given document ID exists in segment.
+     */
+    bool hasDocument(int document_id) const
+    {
+        return (document_id >= 0) && (document_id < documentCount());
+    }
+
+    /**
+     * @brief Gets the path of a document. Document ID must be valid.
+     */
+    std::filesystem::path documentPath(int document_id) const
+    {
+        const SegmentDocument &doc = documents[document_id];
+        std::string_view path = getString(doc.path_offset, doc.path_length);
+        return std::filesystem::path(std::string(path));
+    }
+
+    /**
+     * @brief Gets the manifest entry of a document. Document ID must be valid.
+     */
+    DocumentInfo documentInfo(int document_id) const
+    {
+        const SegmentDocument &doc = documents[document_id];
+        DocumentInfo info;
+        info.path = documentPath(document_id);
+        info.file_size = doc.file_size;
+        info.modified_time = doc.modified_time;
+        info.content_hash = doc.content_hash;
+        info.term_count = lengths[document_id].term_count;
+        info.token_count = lengths[document_id].token_count;
+        return info;
+    }
+
+    /**
+     * @brief Gets the number of distinct terms in a document. Document ID must be valid.
+     */
+    uint32_t documentTermCount(int document_id) const
+    {
+        return lengths[document_id].term_count;
+    }
+
+    /**
+     * @brief Gets the average number of indexed words in documents.
+     */
+    double averageDocumentLength() const
+    {
+        return (double)header->token_count / (double)header->document_count;
+    }
+
+    /**
+     * @brief Gets the number of indexed words in a document. Document ID must be valid.
+     */
+    uint32_t documentTokenCount(int document_id) const
+    {
+        return lengths[document_id].token_count;
+    }
+
+    int termCount() const
+    {
+        return header ? header->term_count : 0;
+    }
+
+    /**
+     * @brief Gets a term from term dictionary by its ID. ID must be valid.
+     */
+    const SegmentTerm &termAt(uint32_t term_id) const
+    {
+        return terms[term_id];
+    }
+
+    /**
+     * @brief Gets the ID of a term entry returned by termAt() or findTerm().
+     */
+    uint32_t termId(const SegmentTerm &term) const
+    {
+        return &term - terms;
+    }
+
+    int surfaceCount() const
+    {
+        return header ? header->surface_count : 0;
+    }
+
+    /**
+     * @brief Gets an original (unstemmed) word from surface form dictionary.
+     */
+    std::string_view surfaceString(uint32_t surface_id) const
+    {
+        if (surface_id >= header->surface_count)
+            throw "Index segment is corrupted: surface form out of bounds.";
+
+        const SegmentSurface &surface = surfaces[surface_id];
+        return getString(surface.string_offset, surface.string_length);
+    }
+
+    /**
+     * @brief Gets the string of a term from term dictionary.
+     */
+    std::string_view termString(const SegmentTerm &term) const
+    {
+        return getString(term.string_offset, term.string_length);
+    }
+
+    /**
+     * @brief Looks up a stemmed term in the term dictionary.
+     *
+     * The dictionary is sorted so this is a binary search that only
+     * touches log(n) entries of the mapped file.
+     *
+     * @param term: The stemmed term to find.
+     *
+     * @returns pointer to the term entry or nullptr if term is not indexed.
+     */
+    const SegmentTerm* findTerm(std::string_view term) const
+    {
+        if (!header)
+            return nullptr;
+
+        uint32_t lo = 0;
+        uint32_t hi = header->term_count;
+
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = termString(terms[mid]).compare(term);
+
+            if (cmp == 0)
+                return &terms[mid];
+            else if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Gets the number of posting blocks of a term.
+     */
+    uint32_t termBlockCount(const SegmentTerm &term) const
+    {
+        return (term.document_frequency + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    }
+
+    /**
+     * @brief Gets the posting blocks of a term.
+     *
+     * @returns pointer to first block. There are termBlockCount() blocks
+     * in ascending order of document IDs.
+     */
+    const SegmentPostingBlock* termBlocks(const SegmentTerm &term) const
+    {
+        if (term.blocks_start + termBlockCount(term) > header->block_count)
+            throw "Index segment is corrupted: blocks out of bounds.";
+
+        return blocks + term.blocks_start;
+    }
+
+    /**
+     * @brief Gets the encoded data of a posting block.
+     *
+     * @param block: The posting block.
+     * @param end: Set to pointer past the end of postings section.
+     */
+    const uint8_t* blockData(const SegmentPostingBlock &block, const uint8_t* &end) const
+    {
+        if (block.data_offset > header->postings_size)
+            throw "Index segment is corrupted: postings out of bounds.";
+
+        end = postings + header->postings_size;
+        return postings + block.data_offset;
+    }
+
+    /**
+     * @brief Finds the posting of a term for the given document.
+     *
+     * @param term: The term entry.
+     * @param document_id: The ID of document.
+     * @param posting: Set to the found posting.
+     *
+     * @returns bool - false if term does not occur in document.
+     */
+    bool findPosting(const SegmentTerm &term, int document_id, SegmentPosting &posting) const;
+
+    /**
+     * @brief Gets the positions of a posting without decoding them.
+     *
+     * @returns pointer to first of `posting.occurrence_count` positions, in order
+     * they occur in document.
+     */
+    const SegmentPosition* postingPositions(const SegmentPosting &posting) const
+    {
+        if (posting.positions_start + posting.occurrence_count > header->position_count)
+            throw "Index segment is corrupted: positions out of bounds.";
+
+        return positions + posting.positions_start;
+    }
+
+    /**
+     * @brief Decodes the occurrences of a term from its posting.
+     *
+     * @param term: The term entry.
+     * @param posting: The posting of term for a document.
+     *
+     * @returns vector<Occurrence> - the decoded occurrences.
+     */
+    std::vector<Occurrence> occurrences(const SegmentTerm &term, const SegmentPosting &posting) const
+    {
+        std::vector<Occurrence> result;
+        result.reserve(posting.occurrence_count);
+
+        uint32_t term_id = termId(term);
+        const SegmentPosition* pos = postingPositions(posting);
+
+        for (uint32_t i = 0; i < posting.occurrence_count; i++, pos++)
+        {
+            Occurrence occ;
+            occ.term_id = term_id;
+            occ.surface_id = pos->surface_id;
+            occ.document_id = posting.document_id;
+            occ.line = pos->line;
+            occ.index = pos->index;
+            occ.position = pos->position;
+            result.push_back(occ);
+        }
+
+        return result;
+    }
+};
+
+
+/**
+ * @brief Finds the first index in [begin, end) whose value is not less than target.
+ *
+ * Values must be in ascending order. The search gallops forward from `begin` in
+ * steps of doubling size and then binary searches the last step, so an index close
+ * to `begin` is found in few comparisons while a distant one takes log(n).
+ *
+ * @param begin: The first index to search from.
+ * @param end: The index past the last value.
+ * @param target: The value to search for.
+ * @param value: Called with an index to get the value at it.
+ *
+ * @returns uint32_t - the found index, or `end` if all values are less than target.
+ */
+template <typename Value>
+uint32_t gallopingSearch(uint32_t begin, uint32_t end, uint32_t target, Value value)
+{
+    uint64_t lo = begin;
+    uint64_t hi = begin;
+    uint64_t step = 1;
+
+    while (hi < end && value(hi) < target)
+    {
+        lo = hi + 1;
+        hi = lo + step;
+        step *= 2;
+    }
+
+    hi = std::min<uint64_t>(hi, end);
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (value(mid) < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Intersects two arrays of document IDs in ascending order.
+ *
+ * When SSE2 is available, four IDs of each array are compared against each other
+ * at once by comparing with all four rotations of the other. The rest are merged
+ * one at a time.
+ *
+ * @param a: The first array.
+ * @param a_count: The number of IDs in first array.
+ * @param b: The second array.
+ * @param b_count: The number of IDs in second array.
+ * @param out: Set to the common IDs. Must have room for min(a_count, b_count) IDs.
+ *
+ * @returns size_t - the number of common IDs.
+ */
+size_t intersectSorted(const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out)
+{
+    size_t i = 0;
+    size_t j = 0;
+    size_t count = 0;
+
+    #ifdef SEARCH100_USE_SSE2
+
+        while (i + 4 <= a_count && j + 4 <= b_count)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+
+            __m128i eq = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1)))),
+                _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))),
+                             _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))))
+            );
+
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+            for (int k = 0; k < 4; k++)
+            {
+                if (mask & (1 << k))
+                    out[count++] = a[i + k];
+            }
+
+            uint32_t a_max = a[i + 3];
+            uint32_t b_max = b[j + 3];
+
+            if (a_max <= b_max)
+                i += 4;
+            if (b_max <= a_max)
+                j += 4;
+        }
+
+    #endif
+
+    while (i < a_count && j < b_count)
+    {
+        if (a[i] < b[j])
+            i++;
+        else if (b[j] < a[i])
+            j++;
+        else
+        {
+            out[count++] = a[i];
+            i++;
+            j++;
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * @brief Iterates over the posting list of a term.
+ *
+ * Postings are decoded one block at a time. When advancing to a document or
+ * pruning low scoring postings, the blocks that cannot contain a wanted posting
+ * are skipped without being decoded.
+ */
+class PostingCursor
+{
+    const IndexSegment* segment;
+    const SegmentPostingBlock* blocks;
+    uint32_t document_frequency;
+    uint32_t block_count;
+
+    /* Index of the decoded block, and of current posting in it. */
+    uint32_t block = 0;
+    uint32_t position = 0;
+    uint32_t size = 0;
+
+    uint32_t document_ids[POSTING_BLOCK_SIZE];
+
+    /* Occurrence counts are only decoded once a posting of block is read, so that
+       intersecting posting lists only decodes the document IDs. */
+    mutable const uint8_t* counts_data = nullptr;
+    mutable const uint8_t* counts_end = nullptr;
+    mutable uint32_t occurrence_counts[POSTING_BLOCK_SIZE];
+    mutable uint64_t positions_starts[POSTING_BLOCK_SIZE];
+
+    void decodeBlock(uint32_t index)
+    {
+        block = index;
+        position = 0;
+        size = 0;
+        counts_data = nullptr;
+
+        if (block >= block_count)
+            return;
+
+        const SegmentPostingBlock &header = blocks[block];
+        const uint8_t* end;
+        const uint8_t* data = segment->blockData(header, end);
+
+        size = std::min(POSTING_BLOCK_SIZE, document_frequency - block * POSTING_BLOCK_SIZE);
+        document_ids[0] = header.first_document_id;
+
+        for (uint32_t i = 1; i < size; i++)
+        {
+            uint32_t gap;
+            data = decodeVarint(data, end, gap);
+            document_ids[i] = document_ids[i - 1] + gap;
+        }
+
+        counts_data = data;
+        counts_end = end;
+    }
+
+    void decodeCounts() const
+    {
+        const uint8_t* data = counts_data;
+        uint64_t positions_start = blocks[block].positions_start;
+
+        for (uint32_t i = 0; i < size; i++)
+        {
+            data = decodeVarint(data, counts_end, occurrence_counts[i]);
+            positions_starts[i] = positions_start;
+            positions_start += occurrence_counts[i];
+        }
+
+        counts_data = nullptr;
+    }
+
+    public:
+
+    PostingCursor(const IndexSegment &segment_inst, const SegmentTerm &term)
+    {
+        segment = &segment_inst;
+        blocks = segment->termBlocks(term);
+        document_frequency = term.document_frequency;
+        block_count = segment->termBlockCount(term);
+        decodeBlock(0);
+    }
+
+    /**
+     * @brief Whether all postings have been iterated.
+     */
+    bool atEnd() const
+    {
+        return block >= block_count;
+    }
+
+    /**
+     * @brief The document ID of current posting. Cursor must not be at end.
+     */
+    uint32_t document() const
+    {
+        return document_ids[position];
+    }
+
+    /**
+     * @brief The current posting. Cursor must not be at end.
+     */
+    SegmentPosting posting() const
+    {
+        if (counts_data)
+            decodeCounts();
+
+        SegmentPosting result;
+        result.document_id = document_ids[position];
+        result.occurrence_count = occurrence_counts[position];
+        result.positions_start = positions_starts[position];
+        return result;
+    }
+
+    /**
+     * @brief Moves to the next posting.
+     */
+    void next()
+    {
+        if (++position >= size)
+            decodeBlock(block + 1);
+    }
+
+    /**
+     * @brief The header of current block. Cursor must not be at end.
+     */
+    const SegmentPostingBlock &currentBlock() const
+    {
+        return blocks[block];
+    }
+
+    /**
+     * @brief Skips the blocks whose postings cannot score high enough.
+     *
+     * Starting from current block, blocks are skipped without being decoded while
+     * `prunable` returns true for them. If current block is kept, the cursor is
+     * left unchanged.
+     *
+     * @param prunable: Called with the header of a block.
+     *
+     * @returns bool - false if all remaining blocks were skipped and cursor is at end.
+     */
+    template <typename Predicate>
+    bool skipBlocks(Predicate prunable)
+    {
+        if (atEnd() || !prunable(blocks[block]))
+            return !atEnd();
+
+        uint32_t next_block = block + 1;
+        while (next_block < block_count && prunable(blocks[next_block]))
+            next_block++;
+
+        decodeBlock(next_block);
+        return !atEnd();
+    }
+
+    /**
+     * @brief Moves to the first posting with document ID not less than target.
+     *
+     * @param target: The document ID to advance to.
+     *
+     * @returns bool - false if there is no such posting and cursor is at end.
+     */
+    bool advance(uint32_t target)
+    {
+        if (atEnd())
+            return false;
+
+        if (blocks[block].last_document_id < target)
+        {
+            decodeBlock(gallopingSearch(block + 1, block_count, target, [this](uint32_t i) {
+                return blocks[i].last_document_id;
+            }));
+
+            if (atEnd())
+                return false;
+        }
+
+        if (document_ids[position] >= target)
+            return true;
+
+        position = gallopingSearch(position + 1, size, target, [this](uint32_t i) {
+            return document_ids[i];
+        });
+
+        return true;
+    }
+
+    /**
+     * @brief Gets the document IDs of current and remaining postings in decoded block.
+     * Cursor must not be at end.
+     *
+     * @param count: Set to the number of document IDs.
+     */
+    const uint32_t* blockDocuments(uint32_t &count) const
+    {
+        count = size - position;
+        return document_ids + position;
+    }
+
+    /**
+     * @brief Moves to the first posting of next block.
+     */
+    void nextBlock()
+    {
+        decodeBlock(block + 1);
+    }
+};
+
+
+bool IndexSegment::findPosting(const SegmentTerm &term, int document_id, SegmentPosting &posting) const
+{
+    PostingCursor cursor(*this, term);
+    if (!cursor.advance(document_id) || (int)cursor.document() != document_id)
+        return false;
+
+    posting = cursor.posting();
+    return true;
+}
+
+
+/**
+ * @brief Writes the given index as a segment file.
+ *
+ * Document IDs in index must be contiguous and start from zero and posting
+ * lists must be sorted by document ID.
+ *
+ * The sections are streamed to the file straight from the index so the index
+ * is never copied in memory. Offsets of sections are only known once they are
+ * written so the header is written last; until then the file begins with an
+ * empty header, and a partially written segment is rejected on load.
+ *
+ * @param filename: The path of segment file to write.
+ * @param index: The index to write.
+ *
+ * @returns bool - true if segment was written successfully.
+ */
+bool writeSegment(const std::string &filename, const InvertedIndex &index)
+{
+    int expected_document_id = 0;
+    for (auto &entry : index.documents)
+    {
+        if (entry.first != expected_document_id++)
+            throw "Document IDs must be contiguous to write a segment.";
+    }
+
+    // Original words are written in sorted order so the segment does not
+    // depend on order in which documents were indexed by threads.
+    std::vector<uint32_t> surface_order(index.surfaces.size());
+    std::vector<uint32_t> surface_map(index.surfaces.size());
+    std::iota(surface_order.begin(), surface_order.end(), 0);
+    std::sort(surface_order.begin(), surface_order.end(), [&index](uint32_t a, uint32_t b) {
+        return index.surfaces[a] < index.surfaces[b];
+    });
+
+    for (uint32_t i = 0; i < surface_order.size(); i++)
+        surface_map[surface_order[i]] = i;
+
+    // Terms are written in sorted order as required by binary search in
+    // IndexSegment::findTerm(). Terms of documents removed on reindexing
+    // may have no postings left; these are skipped.
+    std::vector<uint32_t> term_order;
+    term_order.reserve(index.terms.size());
+
+    for (uint32_t term_id = 0; term_id < index.terms.size(); term_id++)
+    {
+        if (!index.postings[term_id].document_ids.empty())
+            term_order.push_back(term_id);
+    }
+
+    std::sort(term_order.begin(), term_order.end(), [&index](uint32_t a, uint32_t b) {
+        return index.terms[a] < index.terms[b];
+    });
+
+    std::vector<SegmentDocumentLength> document_lengths;
+    document_lengths.reserve(index.documents.size());
+
+    for (auto &entry : index.documents)
+        document_lengths.push_back(SegmentDocumentLength{entry.second.term_count, entry.second.token_count});
+
+    // Sets the score bounds of a term or block entry from postings in [start, end).
+    auto setScoreBounds = [&index, &document_lengths](auto &entry, uint32_t term_id, size_t start, size_t end)
+    {
+        const auto &ids = index.postings[term_id].document_ids;
+        const auto &counts = index.postings[term_id].occurrence_counts;
+
+        entry.max_term_frequency = 0;
+        entry.max_occurrence_count = 0;
+        entry.min_token_count = UINT32_MAX;
+        entry.reserved = 0;
+
+        for (size_t i = start; i < end; i++)
+        {
+            const SegmentDocumentLength &length = document_lengths[ids[i]];
+            entry.max_term_frequency = std::max(entry.max_term_frequency, termFrequencyBound(counts[i], length.term_count));
+            entry.max_occurrence_count = std::max(entry.max_occurrence_count, counts[i]);
+            entry.min_token_count = std::min(entry.min_token_count, length.token_count);
+        }
+    };
+
+    std::vector<char> buffer(1 << 20);
+    std::ofstream fs;
+    fs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    fs.open(filename, std::ios::binary | std::ios::trunc);
+
+    if (!fs)
+        return false;
+
+    SegmentHeader header;
+    std::memset(&header, 0, sizeof(header));
+    fs.write((const char*)&header, sizeof(header));
+
+    auto beginSection = [&fs](uint64_t alignment = 8)
+    {
+        static const char padding[8] = {0};
+        uint64_t offset = fs.tellp();
+        uint64_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+        fs.write(padding, aligned - offset);
+        return aligned;
+    };
+
+    auto writeEntry = [&fs](const auto &entry)
+    {
+        fs.write((const char*)&entry, sizeof(entry));
+    };
+
+    // Strings are stored as document paths, followed by original words and terms.
+    uint64_t string_offset = 0;
+
+    header.documents_offset = beginSection();
+    for (auto &[document_id, info] : index.documents)
+    {
+        SegmentDocument doc;
+        doc.path_offset = string_offset;
+        doc.path_length = info.path.string().length();
+        doc.reserved = 0;
+        doc.file_size = info.file_size;
+        doc.modified_time = info.modified_time;
+        doc.content_hash = info.content_hash;
+
+        string_offset += doc.path_length;
+        writeEntry(doc);
+    }
+
+    uint64_t token_count = 0;
+
+    header.lengths_offset = beginSection();
+    for (auto &length : document_lengths)
+    {
+        token_count += length.token_count;
+        writeEntry(length);
+    }
+
+    uint64_t surfaces_string_offset = string_offset;
+    for (uint32_t surface_id : surface_order)
+        string_offset += index.surfaces[surface_id].length();
+
+    uint64_t block_count = 0;
+
+    header.terms_offset = beginSection();
+    for (uint32_t term_id : term_order)
+    {
+        SegmentTerm term;
+        term.string_offset = string_offset;
+        term.string_length = index.terms[term_id].length();
+        term.blocks_start = block_count;
+        term.document_frequency = index.postings[term_id].document_ids.size();
+        term.idf = std::log((double)index.documents.size() / (double)term.document_frequency);
+        setScoreBounds(term, term_id, 0, term.document_frequency);
+
+        string_offset += term.string_length;
+        block_count += (term.document_frequency + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+        writeEntry(term);
+    }
+
+    string_offset = surfaces_string_offset;
+
+    header.surfaces_offset = beginSection();
+    for (uint32_t surface_id : surface_order)
+    {
+        SegmentSurface surface;
+        surface.string_offset = string_offset;
+        surface.string_length = index.surfaces[surface_id].length();
+        surface.reserved = 0;
+
+        string_offset += surface.string_length;
+        writeEntry(surface);
+    }
+
+    // The encoded size of each block is computed up front so that the blocks
+    // can be written before the postings they point to.
+    uint64_t data_offset = 0;
+    uint64_t positions_start = 0;
+
+    header.blocks_offset = beginSection();
+    for (uint32_t term_id : term_order)
+    {
+        const auto &ids = index.postings[term_id].document_ids;
+        const auto &counts = index.postings[term_id].occurrence_counts;
+
+        for (size_t start = 0; start < ids.size(); start += POSTING_BLOCK_SIZE)
+        {
+            size_t end = std::min(ids.size(), start + POSTING_BLOCK_SIZE);
+
+            SegmentPostingBlock block;
+            block.data_offset = data_offset;
+            block.positions_start = positions_start;
+            block.first_document_id = ids[start];
+            block.last_document_id = ids[end - 1];
+            setScoreBounds(block, term_id, start, end);
+
+            for (size_t i = start + 1; i < end; i++)
+                data_offset += varintLength(ids[i] - ids[i - 1]);
+
+            for (size_t i = start; i < end; i++)
+            {
+                data_offset += varintLength(counts[i]);
+                positions_start += counts[i];
+            }
+
+            writeEntry(block);
+        }
+    }
+
+    std::string encoded;
+
+    header.postings_offset = beginSection(1);
+    for (uint32_t term_id : term_order)
+    {
+        const auto &ids = index.postings[term_id].document_ids;
+        const auto &counts = index.postings[term_id].occurrence_counts;
+
+        for (size_t start = 0; start < ids.size(); start += POSTING_BLOCK_SIZE)
+        {
+            size_t end = std::min(ids.size(), start + POSTING_BLOCK_SIZE);
+            encoded.clear();
+
+            for (size_t i = start + 1; i < end; i++)
+                encodeVarint(encoded, ids[i] - ids[i - 1]);
+
+            for (size_t i = start; i < end; i++)
+                encodeVarint(encoded, counts[i]);
+
+            fs.write(encoded.data(), encoded.size());
+        }
+    }
+
+    header.positions_offset = beginSection();
+    for (uint32_t term_id : term_order)
+    {
+        for (auto &pos : index.postings[term_id].positions)
+        {
+            SegmentPosition position;
+            position.surface_id = surface_map[pos.surface_id];
+            position.line = pos.line;
+            position.index = pos.index;
+            position.position = pos.position;
+            writeEntry(position);
+        }
+    }
+
+    header.strings_offset = beginSection();
+    for (auto &[document_id, info] : index.documents)
+    {
+        std::string path_str = info.path.string();
+        fs.write(path_str.data(), path_str.length());
+    }
+
+    for (uint32_t surface_id : surface_order)
+        fs.write(index.surfaces[surface_id].data(), index.surfaces[surface_id].length());
+
+    for (uint32_t term_id : term_order)
+        fs.write(index.terms[term_id].data(), index.terms[term_id].length());
+
+    std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header.version = SEGMENT_VERSION;
+    header.document_count = index.documents.size();
+    header.term_count = term_order.size();
+    header.surface_count = surface_order.size();
+    header.block_count = block_count;
+    header.postings_size = data_offset;
+    header.position_count = positions_start;
+    header.token_count = token_count;
+    header.file_size = fs.tellp();
+
+    fs.seekp(0);
+    writeEntry(header);
+    fs.close();
+
+    return !fs.fail();
+}
+
+#endif
@@ -4,13 +4,17 @@
 #define _SEARCH100_STEMMING
 
 #include <array>
-#include <sstream>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <set>
 #include <unordered_map>
 #include <vector>
-#include <json.hpp>
 #include "utils.cpp"
 
 const std::string STEP_2_SUFFIXES[][2] = {
@@ -83,7 +87,6 @@ const std::unordered_map<char, std::array<int, 2>> STEP_2_PENULT_MAP = {
     {'o', {10, 13}},
     {'s', {13, 17}},
     {'t', {17, 20}},
-    {'u', {20, 21}},
 };
 
 const std::unordered_map<char, std::array<int, 2>> STEP_3_ULT_MAP = {
@@ -111,7 +114,7 @@ const std::unordered_map<char, std::array<int, 2>> STEP_4_PENULT_MAP = {
 /**
  * @brief Set of stopwords that are ignored during tokenization.
  */
-const std::set<std::string> STOPWORDS = {
+const std::set<std::string, std::less<>> STOPWORDS = {
     "i", "me", "my", "myself", "we", "our", "ours", "ourselves", "you",
     "your", "yours", "yourself", "yourselves", "he", "him", "his", "himself",
     "she", "her", "hers", "herself", "it", "its", "itself", "they", "them",
@@ -133,6 +136,19 @@ const std::set<std::string> STOPWORDS = {
  */
 const std::string PUNCTUATION = "!\"#$%&'()*+, -./:;<=>?@[\\]^_`{|}~";
 
+/**
+ * @brief Lookup table of characters that separate words, i.e. PUNCTUATION and
+ * whitespace, indexed by character value.
+ */
+const std::array<bool, 256> PUNCTUATION_TABLE = []()
+{
+    std::array<bool, 256> table{};
+    for (unsigned char c : PUNCTUATION + "\t\r\n")
+        table[c] = true;
+
+    return table;
+}();
+
 /** @brief Minimum word length required for a word to be stemmed.
  * 
  * If word length is less than this length, the word is ignored
@@ -140,16 +156,80 @@ const std::string PUNCTUATION = "!\"#$%&'()*+, -./:;<=>?@[\\]^_`{|}~";
 */
 const int WORD_STEM_THRESHOLD = 3;
 
+/**
+ * @brief Maximum length of a word that is stemmed.
+ * 
+ * Words are stemmed in a buffer of this size so no memory is allocated
+ * while stemming. Longer words are left unstemmed.
+ */
+const int STEM_BUFFER_SIZE = 64;
+
 /**
  * @brief Checks whether a word is stemmable or not.
  * 
  * This does not account for punctuation.
  */
-bool checkWordStemmable(std::string word)
+bool checkWordStemmable(std::string_view word)
 {
-    return !((word.length() < WORD_STEM_THRESHOLD) || (STOPWORDS.count(word) > 0));
+    return !((word.length() < WORD_STEM_THRESHOLD) || (STOPWORDS.find(word) != STOPWORDS.end()));
 }
 
+/**
+ * @brief Splits a line into words without copying it.
+ * 
+ * The line is trimmed of surrounding whitespace and then split at whitespace
+ * and punctuation marks. If a punctuation is at the end of word e.g. "dog.",
+ * it is simply removed "dog." -> "dog" but if the punctuation is in middle
+ * of word, the word is split at that point and treated as two (or more)
+ * separate words. For example, "hello#world" is split into "hello" and "world".
+ * 
+ * The words are views into the line so the line must outlive the tokenizer.
+ */
+class Tokenizer
+{
+    std::string_view line;
+    size_t position = 0;
+    size_t end = 0;
+
+    public:
+
+    Tokenizer(std::string_view line_view)
+    {
+        line = line_view;
+        position = line.find_first_not_of(" \n\r\t");
+
+        if (position == std::string_view::npos)
+            position = 0;
+        else
+            end = line.find_last_not_of(" \n\r\t") + 1;
+    }
+
+    /**
+     * @brief Gets the next word in line.
+     * 
+     * @param word: Set to the word.
+     * @param index: Set to the position of word in the line.
+     * 
+     * @returns bool - false if there are no more words.
+     */
+    bool next(std::string_view &word, int &index)
+    {
+        while (position < end && PUNCTUATION_TABLE[(unsigned char)line[position]])
+            position++;
+
+        if (position >= end)
+            return false;
+
+        size_t start = position;
+        while (position < end && !PUNCTUATION_TABLE[(unsigned char)line[position]])
+            position++;
+
+        word = line.substr(start, position - start);
+        index = start;
+        return true;
+    }
+};
+
 /**
  * @brief Describes a stemmed word.
  */
@@ -160,7 +240,13 @@ class Stem
     /**
      * @brief The position of the stemmed word in the line.
      */
-    int index;
+    int index = 0;
+
+    /**
+     * @brief The ordinal of word among all words of text (including stop words
+     * and other words that are not stemmed).
+     */
+    int position = 0;
 
     /**
      * @brief The original (unstemmed) form of word.
@@ -174,52 +260,117 @@ class Stem
 };
 
 /**
- * @brief Describes a stemmed word that has information about its position
- * within a specific line and document.
+ * @brief The number of shards that a StemCache is split into.
+ */
+const int STEM_CACHE_SHARDS = 16;
+
+/**
+ * @brief Bounded cache of stems, keyed on lowercased word.
+ * 
+ * Word frequencies in natural language text are heavily skewed so most words
+ * being stemmed have been stemmed before. The cache can be shared by multiple
+ * threads; it is split into shards that are locked separately so threads
+ * stemming different words rarely wait for each other.
+ * 
+ * Once a shard is full, no more words are added to it. The words seen first
+ * are generally the most frequent ones so these are kept.
  */
-class Occurrence: public Stem
+class StemCache
 {
+    struct Shard
+    {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, std::string> stems;
+    };
+
+    Shard shards[STEM_CACHE_SHARDS];
+    size_t shard_capacity;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    Shard &getShard(const std::string &word)
+    {
+        return shards[std::hash<std::string>{}(word) % STEM_CACHE_SHARDS];
+    }
+
     public:
 
     /**
-     * @brief The ID of document that this occurrence is present in.
+     * @param capacity: The maximum number of words in cache.
      */
-    int document_id = -1;
+    StemCache(size_t capacity = 65536)
+    {
+        shard_capacity = capacity / STEM_CACHE_SHARDS;
+    }
 
     /**
-     * @brief The line number in which word occurs.
+     * @brief Looks up the stem of a word.
+     * 
+     * @param word: The lowercased word.
+     * @param stem: Set to the stem, if word is in cache.
+     * 
+     * @returns bool - true if word is in cache.
      */
-    int line = -1;
+    bool find(const std::string &word, std::string &stem)
+    {
+        Shard &shard = getShard(word);
+        std::shared_lock lock(shard.mutex);
+
+        auto it = shard.stems.find(word);
+        if (it == shard.stems.end())
+        {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        hits.fetch_add(1, std::memory_order_relaxed);
+        stem = it->second;
+        return true;
+    }
 
-    nlohmann::json toJSON()
+    /**
+     * @brief Adds the stem of a word to cache, unless cache is full.
+     */
+    void insert(const std::string &word, const std::string &stem)
     {
-        return nlohmann::json({
-            {"line", line},
-            {"index", index},
-            {"original", original},
-        });
+        Shard &shard = getShard(word);
+        std::unique_lock lock(shard.mutex);
+
+        if (shard.stems.size() < shard_capacity)
+            shard.stems.emplace(word, stem);
     }
 
     /**
-     * @brief Creates an `Occurrence` class instance from `Stem` instance.
-     * 
-     * @param document_id: The document ID for this occurrence.
-     * @param line: The line number for this occurrence.
-     * 
-     * @return `Occurrence`
+     * @brief Removes all words from cache and resets the counters.
      */
-    static Occurrence fromStem(Stem stem, int document_id = -1, int line = -1)
+    void clear()
     {
-        Occurrence occ;
-        occ.index = stem.index;
-        occ.original = stem.original;
-        occ.stemmed = stem.stemmed;
-        occ.document_id = document_id;
-        occ.line = line;
-        return occ;
+        for (Shard &shard : shards)
+        {
+            std::unique_lock lock(shard.mutex);
+            shard.stems.clear();
+        }
+
+        hits = 0;
+        misses = 0;
+    }
+
+    /**
+     * @brief The number of lookups that found the word in cache.
+     */
+    uint64_t getHits() const
+    {
+        return hits.load(std::memory_order_relaxed);
     }
-};
 
+    /**
+     * @brief The number of lookups that did not find the word in cache.
+     */
+    uint64_t getMisses() const
+    {
+        return misses.load(std::memory_order_relaxed);
+    }
+};
 
 /**
  * @brief Implementation of Porter Stemmer algorithm.
@@ -246,11 +397,23 @@ class Occurrence: public Stem
  * The algorithm is wrapped in this class to easily track the string being stemmed
  * across subsequent steps. To stem a sequence of words, use the stemLine() method.
  * 
+ * A stemmer is not thread safe but multiple stemmers may share a StemCache.
+ * 
  */
 class PorterStemmer
 {
+    StemCache* cache;
+
     public:
 
+    /**
+     * @param stem_cache: The cache to look up stems in. If nullptr, every word is stemmed.
+     */
+    PorterStemmer(StemCache* stem_cache = nullptr)
+    {
+        cache = stem_cache;
+    }
+
     /**
      * @brief Stems a line.
      * 
@@ -262,57 +425,37 @@ class PorterStemmer
      * @returns Vector containing position aware stemmed words.
      * 
      */
-    std::vector<Stem> stemLine(std::string text)
+    std::vector<Stem> stemLine(std::string_view text)
     {
-        int index = 0;
-        int trailing_spaces = text.find_first_not_of(" \n\r\t");
-
-        index += trailing_spaces;
-
-        text.erase(text.find_last_not_of(" \n\r\t") + 1);
-        text.erase(0, trailing_spaces);
+        int position = 0;
+        return stemLine(text, position);
+    }
 
-        std::istringstream iss(text);
-        std::string word;
+    /**
+     * @brief Stems a line that is part of a larger text.
+     * 
+     * @param text: The line to stem.
+     * @param position: The ordinal of first word of line in text. This is advanced
+     * past all words of line, including the ones that are removed.
+     * 
+     * @returns Vector containing position aware stemmed words.
+     */
+    std::vector<Stem> stemLine(std::string_view text, int &position)
+    {
+        Tokenizer tokenizer(text);
         std::vector<Stem> stems;
+        std::string_view word;
+        int index;
 
-        // Tokenization (split line into words)
-        while (std::getline(iss, word, ' '))
+        while (tokenizer.next(word, index))
         {
-            int prev = 0;
-            int pos;
-
-            // If we encounter a word with punctuation, we split the word further
-            // with delimiters as punctuation marks. This means if a punctuation is
-            // at the end e.g. "dog.", it is simply removed "dog." -> "dog" but if the
-            // punctuation is in middle of word. The word is split at that point and
-            // treated as two (or more) separate words. For example, "hello#world" will
-            // be treated separately as "hello" and "world".
-            while ((pos = word.find_first_of(PUNCTUATION, prev)) != std::string::npos)
+            if (checkWordStemmable(word))
             {
-                if (pos > prev)
-                {
-                    std::string part = word.substr(prev, pos - prev);
-                    if (checkWordStemmable(part))
-                        stems.push_back(stemWord(part, index));
-
-                    index += part.length();
-                }
-
-                index++;  // account for removed punctuation character
-                prev = pos + 1;
+                stems.push_back(stemWord(word, index));
+                stems.back().position = position;
             }
 
-            std::string part;
-            if (prev < word.length())
-            {
-                part = word.substr(prev);
-
-                if (checkWordStemmable(part))
-                    stems.push_back(stemWord(part, index));
-            }
-
-            index += part.length() + 1;  // +1 to account for removed space char
+            position++;
         }
 
         return stems;
@@ -328,11 +471,11 @@ class PorterStemmer
      * 
      * @returns `Stem` - the stemmed word.
      */
-    Stem stemWord(std::string word, int index)
+    Stem stemWord(std::string_view word, int index)
     {
         Stem obj;
         obj.index = index;
-        obj.original = word;
+        obj.original = std::string(word);
         obj.stemmed = stem(word);
         return obj;
     }
@@ -340,11 +483,27 @@ class PorterStemmer
     /**
      * @brief Stems a single word.
      * 
+     * Words longer than STEM_BUFFER_SIZE are not stemmed and are only
+     * converted to lowercase.
+     * 
      * @returns string - the stemmed word.
      */
-    std::string stem(std::string text)
+    std::string stem(std::string_view text)
     {
-        data = stringToLower(text);
+        if (text.length() > STEM_BUFFER_SIZE)
+            return stringToLower(std::string(text));
+
+        setData(text);
+
+        std::string word;
+        std::string result;
+
+        if (cache)
+        {
+            word = getData();
+            if (cache->find(word, result))
+                return result;
+        }
 
         step1a();
         step1b();
@@ -355,13 +514,47 @@ class PorterStemmer
         step5a();
         step5b();
 
-        return data;
+        result = getData();
+        if (cache)
+            cache->insert(word, result);
+
+        return result;
     }
 
-    std::string data;
+    /**
+     * The word being stemmed is kept in a fixed buffer along with whether each of
+     * its characters is a consonant. Steps only change the end of the word so they
+     * shrink `length` or rewrite the suffix, and the consonant flags are updated
+     * from the first changed character onwards.
+     */
+    char data[STEM_BUFFER_SIZE];
+    bool consonants[STEM_BUFFER_SIZE];
+    int length = 0;
 
     /**
-     * @brief Determines whether character at given index is consonant.
+     * @brief Loads a word into buffer, converting it to lowercase.
+     * 
+     * The word must not be longer than STEM_BUFFER_SIZE.
+     */
+    void setData(std::string_view word)
+    {
+        length = word.length();
+        for (int i = 0; i < length; i++)
+            data[i] = std::tolower((unsigned char)word[i]);
+
+        updateConsonants(0);
+    }
+
+    /**
+     * @brief Gets the word in buffer.
+     */
+    std::string getData() const
+    {
+        return std::string(data, length);
+    }
+
+    /**
+     * @brief Recomputes the consonant flags of characters starting from given index.
      * 
      * In Porter Stemmer's specification, consonant is any alphabetical letter
      * other than A, E, I, O, U, and Y after a consonant. Anything that's not a
@@ -369,26 +562,50 @@ class PorterStemmer
      * 
      * TOY -> T and Y are consonant.
      * SYZYGY -> S, Z, and G are consonant (Y is a vowel as it has consonant before it)
+     */
+    void updateConsonants(int start)
+    {
+        for (int i = start; i < length; i++)
+        {
+            char c = data[i];
+            if ((c == 'a') || (c == 'e') || (c == 'i') || (c == 'o') || (c == 'u'))
+                consonants[i] = false;
+            else if (c == 'y')
+                consonants[i] = (i == 0) || !consonants[i - 1];
+            else
+                consonants[i] = true;
+        }
+    }
+
+    /**
+     * @brief Checks whether the word in buffer ends with given suffix.
+     */
+    bool endsWith(std::string_view suffix) const
+    {
+        return ((int)suffix.length() <= length)
+            && (std::memcmp(data + length - suffix.length(), suffix.data(), suffix.length()) == 0);
+    }
+
+    /**
+     * @brief Replaces the last `suffix_length` characters of word with given replacement.
+     */
+    void replaceSuffix(int suffix_length, std::string_view replacement)
+    {
+        int start = length - suffix_length;
+        std::memcpy(data + start, replacement.data(), replacement.length());
+        length = start + replacement.length();
+        updateConsonants(start);
+    }
+
+    /**
+     * @brief Determines whether character at given index is consonant.
      * 
      * @param index: the index of character to test from string.
      * @return bool
      * */
-    bool isConsonant(int index)
+    bool isConsonant(int index) const
     {
-        char c = data.at(index);
-        if ((c == 'a') || (c == 'e') || (c == 'i') || (c == 'o') || (c == 'u'))
-            return false;
-
-        if (c == 'y')
-        {
-            if (index == 0)
-                return true;
-
-            if (isConsonant(index - 1))
-                return false;
-        }
-
-        return true;
+        return consonants[index];
     }
 
     /**
@@ -402,7 +619,8 @@ class PorterStemmer
      * `[C](VC){m}[V]`
      * 
      * [C] and [V] indicate arbitrary presence of C and V and (VC){m} indicates presence of
-     * V and C, in order, "m" number of times.
+     * V and C, in order, "m" number of times. This is the number of vowels that are
+     * followed by a consonant.
      * 
      * For more information, see algorithm's specification.
      * 
@@ -410,60 +628,14 @@ class PorterStemmer
      * 
      * @return the value of m
      * */
-    int getm(int suffix_length)
+    int getm(int suffix_length) const
     {
-        int i;
-        int start = -1;
         int m = 0;
-        int len = data.length() - suffix_length;
-        std::string old_data = data;
-        data.replace(len, suffix_length, "");
-
-        for (i = 0; i < len; i++)
-        {
-            if (!isConsonant(i))
-            {
-                start = i;
-                break;
-            }
-        }
-
-        if (start == -1)
-        {
-            data = old_data;
-            return 0;
-        }
-
-        int end = -1;
-
-        for (i = len - 1; i > start; i--)
-        {
-            if (isConsonant(i))
-            {
-                end = i;
-                break;
-            }
-        }
-
-        if ((end < start) || (end == -1))
-        {
-            data = old_data;
-            return 0;
-        }
+        int len = length - suffix_length;
 
-        bool v = true;
-        for (i = start; i <= end; i++)
-        {
-            if (isConsonant(i) && v)
-            {
-                m += 1;
-                v = false;
-            }
-            else if (!isConsonant(i) && !v)
-                v = true;
-        }
+        for (int i = 1; i < len; i++)
+            m += (consonants[i] && !consonants[i - 1]);
 
-        data = old_data;
         return m;
     }
 
@@ -474,37 +646,26 @@ class PorterStemmer
      * 
      * @returns true if data contains vowel and vice versa.
      */
-    bool containsVowel(int suffix_length)
-    {
-        std::string old_data = data;
-        data.replace(data.length() - suffix_length, suffix_length, "");
-
-        bool res;
-        if (data.find('a') != std::string::npos)
-            res = true;
-        else if (data.find('e') != std::string::npos)
-            res = true;
-        else if (data.find('i') != std::string::npos)
-            res = true;
-        else if (data.find('o') != std::string::npos)
-            res = true;
-        else if (data.find('u') != std::string::npos)
-            res = true;
-
-        if (res)
+    bool containsVowel(int suffix_length) const
+    {
+        int len = length - suffix_length;
+        int y_index = -1;
+
+        for (int i = 0; i < len; i++)
         {
-            data = old_data;
-            return res;
+            char c = data[i];
+            if ((c == 'a') || (c == 'e') || (c == 'i') || (c == 'o') || (c == 'u'))
+                return true;
+
+            if ((c == 'y') && (y_index == -1))
+                y_index = i;
         }
 
-        int y_index = data.find('y');
-        if ((y_index == std::string::npos) || (y_index == 0))
-            res = false;
-        else
-            res = isConsonant(y_index - 1);
+        // Only the first Y is considered.
+        if (y_index <= 0)
+            return false;
 
-        data = old_data;
-        return res;
+        return consonants[y_index - 1];
     }
 
     /**
@@ -520,27 +681,14 @@ class PorterStemmer
      *
      * @returns boolean
      */
-    bool doubleConsonantSuffix(int suffix_length)
+    bool doubleConsonantSuffix(int suffix_length) const
     {
-        int len = data.length() - suffix_length;
+        int len = length - suffix_length;
 
         if (len < 2)
             return false;
 
-        std::string old_data = data;
-        data.replace(len, suffix_length, "");
-
-        int last = len - 1;
-        int second_last = len - 2;
-
-        bool res;
-        if (isConsonant(last))
-            res = data.at(second_last) == data.at(last);
-        else
-            res = false;
-
-        data = old_data;
-        return res;
+        return consonants[len - 1] && (data[len - 2] == data[len - 1]);
     }
 
     /**
@@ -555,87 +703,82 @@ class PorterStemmer
      */
     bool endsCVC(int suffix_length)
     {
-        int len = data.length() - suffix_length;
-        std::string old_data = data;
-        data.replace(len, suffix_length, "");
+        int len = length - suffix_length;
 
+        // Stems shorter than three characters have always had the suffix removed
+        // here. This is kept so that words are stemmed the same as in existing indexes.
         if (len < 3)
+        {
+            length = len;
             return false;
+        }
 
-        int c1_index = len - 3;
-        int v_index = len - 2;
-        int c2_index = len - 1;
-        char c2 = data.at(c2_index);
+        char c2 = data[len - 1];
 
-        bool res;
-        if (isConsonant(c1_index) && !isConsonant(v_index) && isConsonant(c2_index))
-            res = ((c2 != 'w') && (c2 != 'x') && (c2 != 'y'));
-        else
-            res = false;
+        if (consonants[len - 3] && !consonants[len - 2] && consonants[len - 1])
+            return ((c2 != 'w') && (c2 != 'x') && (c2 != 'y'));
 
-        data = old_data;
-        return res;
+        return false;
     }
 
     void step1a()
     {
-        int len = data.length();
-        if (stringEndsWith(data, "sses"))
-            data.replace(data.length() - 4, 4, "ss");
-        else if (stringEndsWith(data, "ies"))
-            data.replace(data.length() - 3, 3, "i");
-        else if (stringEndsWith(data, "s") && !stringEndsWith(data, "ss"))
-            data.pop_back();
+        if (endsWith("sses"))
+            replaceSuffix(4, "ss");
+        else if (endsWith("ies"))
+            replaceSuffix(3, "i");
+        else if (endsWith("s") && !endsWith("ss"))
+            length--;
     }
 
     void step1b()
     {
         bool followup = false;
-        if (stringEndsWith(data, "eed"))
+        if (endsWith("eed"))
         {
             if ((getm(3) > 0))
-                data.replace(data.length() - 3, 3, "ee");
+                length--;
         }
-        else if (stringEndsWith(data, "ing"))
+        else if (endsWith("ing"))
         {
             if (containsVowel(3))
             {
-                data.replace(data.length() - 3, 3, "");
+                length -= 3;
                 followup = true;
             }
         }
-        else if (stringEndsWith(data, "ed"))
+        else if (endsWith("ed"))
         {
             if (containsVowel(2))
             {
                 followup = true;
-                data.replace(data.length() - 2, 2, "");;
+                length -= 2;
             }
         }
 
         if (followup)
         {
-            if (stringEndsWith(data, "at") || stringEndsWith(data, "bl") || stringEndsWith(data, "iz"))
-                data.push_back('e');
+            if (endsWith("at") || endsWith("bl") || endsWith("iz"))
+                replaceSuffix(0, "e");
             else if (doubleConsonantSuffix(0))
             {
-                if (!(stringEndsWith(data, "l") || stringEndsWith(data, "s") || stringEndsWith(data, "z")))
-                    data.pop_back();
+                if (!(endsWith("l") || endsWith("s") || endsWith("z")))
+                    length--;
             }
             else if (endsCVC(0))
             {
                 if (getm(0) == 1)
-                    data.push_back('e');
+                    replaceSuffix(0, "e");
             }
         }
     }
 
     void step1c()
     {
-        if (stringEndsWith(data, "y"))
+        if (endsWith("y"))
         {
             if (containsVowel(1))
-                data.replace(data.length() - 1, 1, "i");
+                replaceSuffix(1, "i");
         }
     }
 
@@ -647,15 +790,14 @@ class PorterStemmer
     {
         for (int i = start; i < end; i++)
         {
-            std::string s1 = arr[i][0];
-            std::string s2 = arr[i][1];
+            const std::string &s1 = arr[i][0];
 
-            if (stringEndsWith(data, s1))
+            if (endsWith(s1))
             {
                 int s1_len = s1.length();
                 if (getm(s1_len) > m)
                 {
-                    data.replace(data.length() - s1_len, s1_len, s2);
+                    replaceSuffix(s1_len, arr[i][1]);
                     break;
                 }
             }
@@ -667,88 +809,79 @@ class PorterStemmer
      * @brief Gets lower and upper bounds for given penultimate/ultimate character
      * in suffixes 2D arrays.
      */
-    void getSuffixBounds(const std::unordered_map<char, std::array<int, 2>> hash_map, char c, int &start, int &end)
+    void getSuffixBounds(const std::unordered_map<char, std::array<int, 2>> &hash_map, char c, int &start, int &end)
     {
         start = 0;
         end = 0;
 
-        if (!hash_map.count(c))
+        auto it = hash_map.find(c);
+        if (it == hash_map.end())
             return;
 
-        auto bounds = hash_map.at(c);
-        start = bounds[0];
-        end = bounds[1];
+        start = it->second[0];
+        end = it->second[1];
     }
 
     void step2()
     {
         int start, end;
-        int len = data.length();
 
-        if (len < 2)
+        if (length < 2)
             return;
 
-        getSuffixBounds(STEP_2_PENULT_MAP, data.at(len - 2), start, end);
+        getSuffixBounds(STEP_2_PENULT_MAP, data[length - 2], start, end);
         processSuffixArray(STEP_2_SUFFIXES, start, end, 0);
     }
 
     void step3()
     {
         int start, end;
-        int len = data.length();
 
-        if (len < 1)
+        if (length < 1)
             return;
 
-        getSuffixBounds(STEP_3_ULT_MAP, data.at(len - 1), start, end);
+        getSuffixBounds(STEP_3_ULT_MAP, data[length - 1], start, end);
         processSuffixArray(STEP_3_SUFFIXES, start, end, 0);
     }
 
     void step4()
     {
         int start, end;
-        int len = data.length();
 
-        if (len < 2)
+        if (length < 2)
             return;
         
         // The -ION suffix requires special treatment because
         // it has *S and *T forms in condition as well that
         // processPrefixArray does not handle.
-        if (stringEndsWith(data, "ion"))
+        if (endsWith("ion"))
         {
-            std::string old_data = data;
-            data = data.replace(len - 3,  3, "");
-            if (stringEndsWith(data, "s") || stringEndsWith(data, "t"))
-            {
-                if (!(getm(0) > 1))
-                    data = old_data;
-            }
-            else
-                data = old_data;
+            int len = length - 3;
+            if ((len > 0) && ((data[len - 1] == 's') || (data[len - 1] == 't')) && (getm(3) > 1))
+                length = len;
 
             return;
         }
 
-        getSuffixBounds(STEP_4_PENULT_MAP, data.at(len - 2), start, end);
+        getSuffixBounds(STEP_4_PENULT_MAP, data[length - 2], start, end);
         processSuffixArray(STEP_4_SUFFIXES, start, end, 1);
     }
 
     void step5a()
     {
-        if (stringEndsWith(data, "e"))
+        if (endsWith("e"))
         {
             int m = getm(1);
             if ((m > 1) || ((m == 1) && !endsCVC(1)))
-                data.replace(data.length() - 1, 1, "");
+                length--;
         }
     }
 
     void step5b()
     {
         int m = getm(0);
-        if ((m > 1) && doubleConsonantSuffix(0) && stringEndsWith(data, "l"))
-            data.replace(data.length() - 1, 1, "");
+        if ((m > 1) && doubleConsonantSuffix(0) && endsWith("l"))
+            length--;
     }
 };
 
@@ -0,0 +1,178 @@
+/* Copyright (C) Izhar Ahmad & Mustafa Hussain Qizilbash, 2024-2025 */
+
+#ifndef _SEARCH100_THREAD_POOL
+#define _SEARCH100_THREAD_POOL
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of threads that run the tasks of parallel jobs.
+ *
+ * A job is a number of independent tasks. The thread that submits a job runs its
+ * tasks too, so a job always finishes even if all threads of pool are busy with
+ * jobs of other callers; the pool only adds threads to finish it sooner. Jobs may
+ * be submitted from any number of threads at once.
+ */
+class ThreadPool
+{
+    struct Job
+    {
+        std::function<void(size_t)> task;
+        size_t count = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::thread> threads;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+
+    static void runTasks(Job &job)
+    {
+        size_t i;
+        while ((i = job.next++) < job.count)
+        {
+            try
+            {
+                job.task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (!job.error)
+                    job.error = std::current_exception();
+            }
+
+            if (++job.done == job.count)
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.finished.notify_all();
+            }
+        }
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+                if (jobs.empty())
+                    return;
+
+                job = jobs.front();
+
+                // Once all tasks of a job are taken, the job no longer needs threads.
+                if (job->next >= job->count)
+                {
+                    jobs.pop_front();
+                    continue;
+                }
+            }
+
+            runTasks(*job);
+        }
+    }
+
+    public:
+
+    /**
+     * @param thread_count: The number of threads in pool, besides the threads
+     * that submit jobs.
+     */
+    ThreadPool(size_t thread_count)
+    {
+        for (size_t i = 0; i < thread_count; i++)
+            threads.emplace_back(&ThreadPool::work, this);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        available.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    /**
+     * @brief The number of threads that may run tasks of a job, including the
+     * thread that submits it.
+     */
+    size_t size() const
+    {
+        return threads.size() + 1;
+    }
+
+    /**
+     * @brief Runs tasks in parallel and waits for all of them to finish.
+     *
+     * If a task throws, the first exception thrown is rethrown once all tasks have
+     * finished.
+     *
+     * @param count: The number of tasks.
+     * @param task: Called with the index of each task, from 0 to count - 1.
+     */
+    template <typename Task>
+    void run(size_t count, Task task)
+    {
+        auto job = std::make_shared<Job>();
+        job->task = task;
+        job->count = count;
+
+        if (count > 1 && !threads.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(job);
+            }
+
+            available.notify_all();
+        }
+
+        runTasks(*job);
+
+        {
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->finished.wait(lock, [&job]() { return job->done == job->count; });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto it = jobs.begin(); it != jobs.end(); ++it)
+            {
+                if (*it == job)
+                {
+                    jobs.erase(it);
+                    break;
+                }
+            }
+        }
+
+        if (job->error)
+            std::rethrow_exception(job->error);
+    }
+};
+
+#endif
@@ -3,7 +3,10 @@
 #ifndef _SEARCH100_UI_COMPONENTS
 #define _SEARCH100_UI_COMPONENTS
 
+#include <cmath>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <SFML/Graphics.hpp>
 #include "stemming.cpp"
 #include "engine.cpp"
@@ -44,6 +47,36 @@ class StatusBar: public Component
      */
     sf::Text text;
 
+    /**
+     * @brief Shows the progress of documents being indexed in the bar.
+     * 
+     * @param progress: The indexing progress.
+     * @param index_size: The number of documents that can be searched meanwhile.
+     */
+    void showIndexingProgress(const IndexingProgress &progress, int index_size)
+    {
+        if (!progress.files_total)
+        {
+            text.setString("Preparing indexes...");
+            return;
+        }
+
+        std::ostringstream message;
+        message << std::fixed << std::setprecision(1);
+
+        if (index_size)
+            message << "Ready | " << index_size << " documents | ";
+
+        message << "Indexing " << progress.files_done << "/" << progress.files_total << " documents ("
+                << progress.bytes_done / 1048576.0 << "/" << progress.bytes_total / 1048576.0 << " MB)";
+
+        double remaining = progress.getRemainingSeconds();
+        if (remaining >= 0)
+            message << " | About " << (int)std::ceil(remaining) << "s remaining";
+
+        text.setString(message.str());
+    }
+
     void draw(sf::RenderWindow &window, State* &state, AppData &data)
     {
         auto win_size = window.getSize();
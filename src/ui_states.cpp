@@ -11,6 +11,12 @@
 #include "engine.cpp"
 #include "ui_utils.cpp"
 
+/**
+ * @brief The number of search results fetched at a time. Should be more than the
+ * number of results that fit in a page of search state.
+ */
+const int SEARCH_FETCH_SIZE = 10;
+
 /**
  * @brief Class to store application data.
  * 
@@ -141,6 +147,16 @@ class StateSearch: public State
      */
     std::vector<SearchResult> results;
 
+    /**
+     * @brief The cursor to fetch more results after `results` with.
+     */
+    SearchCursor cursor;
+
+    /**
+     * @brief The decoded occurrences of results that have been drawn, by index of result.
+     */
+    std::map<int, std::vector<Occurrence>> result_occurrences;
+
     /**
      * @brief Back to home button.
      */
@@ -279,19 +295,30 @@ class StateSearch: public State
         int lb, ub;
         getPageBounds(lb, ub);
 
+        // Results are fetched page by page from engine as they are needed to fill a page.
+        while (cursor.hasMore() && ((int)results.size() - lb) < SEARCH_FETCH_SIZE)
+        {
+            SearchPage page = data.engine.nextPage(cursor);
+            results.insert(results.end(), page.results.begin(), page.results.end());
+            cursor = page.cursor;
+        }
+
+        getPageBounds(lb, ub);
+
         int index = 0;
         bool empty = sf_result_headings.empty();
 
         for (int i = lb; i <= ub; i++)
         {
-            auto entry = results[i];
+            const SearchResult &entry = results[i];
+            uint32_t occurrence_count = entry.getOccurrenceCount();
 
             int y_occurrence = 15;
             int dy_occurrence = 40;
 
-            std::filesystem::path path = data.engine.getDocumentPath(entry.document_id);
+            std::filesystem::path path = entry.getDocumentPath();
             std::string document = path.filename().string();
-            sf::RectangleShape sf_result_entry(sf::Vector2f(800, entry.occurrences.size() * dy_occurrence + 20));
+            sf::RectangleShape sf_result_entry(sf::Vector2f(800, occurrence_count * dy_occurrence + 20));
 
             sf_result_entry.setFillColor(sf::Color(180, 180, 180, 0.3));
             sf_result_entry.setOutlineColor(sf::Color(190, 190, 190));
@@ -310,7 +337,7 @@ class StateSearch: public State
 
             if (empty)
             {
-                sf_result_heading = sf::Text(document + " (" + std::to_string(entry.occurrences.size()) + ")",
+                sf_result_heading = sf::Text(document + " (" + std::to_string(occurrence_count) + ")",
                                              data.fonts["Roboto"], 22);
                 sf_result_heading.setFillColor(sf::Color::Blue);
                 sf_result_heading.setStyle(sf::Text::Bold);
@@ -334,10 +361,15 @@ class StateSearch: public State
                 index++;
             }
 
-            for (auto &occurrence : entry.occurrences)
+            // Occurrences are only decoded once the result is on a page being drawn.
+            auto decoded = result_occurrences.find(i);
+            if (decoded == result_occurrences.end())
+                decoded = result_occurrences.emplace(i, entry.getOccurrences()).first;
+
+            for (auto &occurrence : decoded->second)
             {
                 sf::Text text("Line " + std::to_string(occurrence.line + 1) + ", Column " +
-                              std::to_string(occurrence.index + 1) + ": \"" + occurrence.original + "\"",
+                              std::to_string(occurrence.index + 1) + ": \"" + entry.getSurfaceForm(occurrence) + "\"",
                               data.fonts["Roboto"], 22);
 
                 text.setPosition(sf_result_entry.getPosition() + sf::Vector2f(20, y_occurrence));
@@ -350,7 +382,7 @@ class StateSearch: public State
             window.draw(sf_result_entry);
             window.draw(sf_result_heading);
 
-            if (i == (results.size() - 1))
+            if (i == (results.size() - 1) && !cursor.hasMore())
                 max_page_number = page_number;
         }
     }
@@ -367,7 +399,8 @@ class StateSearch: public State
         else if (search_results_fetched && !results.size())
             sf_result_text.setString("No results found for \"" + query + "\"");
         else
-            sf_result_text.setString(std::to_string(results.size()) + " results found for \"" + query + "\"");
+            sf_result_text.setString(std::to_string(results.size()) + (cursor.hasMore() ? "+" : "")
+                                     + " results found for \"" + query + "\"");
 
         sf_back_home_button = sf::RectangleShape(sf::Vector2f(120, 50));
         if (back_home_button_hovered)
@@ -426,7 +459,9 @@ class StateSearch: public State
 
         if (!search_results_fetched)
         {
-            results = data.engine.search(query, search_strategy_and);
+            SearchPage page = data.engine.searchPage(query, search_strategy_and, SEARCH_FETCH_SIZE);
+            results = std::move(page.results);
+            cursor = page.cursor;
             search_results_fetched = true;
         }
 
@@ -6,8 +6,13 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <sys/stat.h>
 
 /**
@@ -18,13 +23,12 @@
  * 
  * @return bool - true if ending matched.
  */
-bool stringEndsWith(std::string data, std::string substr)
+bool stringEndsWith(std::string_view data, std::string_view substr)
 {
-    int diff = data.length() - substr.length();
-    if (diff < 0)
+    if (data.length() < substr.length())
         return false;
 
-    return (data.substr(diff) == substr);
+    return (data.substr(data.length() - substr.length()) == substr);
 }
 
 /**
@@ -40,6 +44,26 @@ std::string stringToLower(std::string data)
     return data;
 }
 
+/**
+ * @brief Computes the 64-bit FNV-1a hash of given data.
+ * 
+ * https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+ * 
+ * @param data: the data to hash.
+ * 
+ * @return uint64_t - the hash value.
+ */
+uint64_t hashFNV1a(std::string_view data)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : data)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /**
  * @brief Checks whether a file exists.
  * 
@@ -52,9 +76,80 @@ bool checkFileExists (const std::string &name) {
   return (stat(name.c_str(), &buffer) == 0); 
 }
 
+/**
+ * @brief Reads the whole content of a file.
+ * 
+ * @param path: the path of file.
+ * 
+ * @return string - the file content (empty if file cannot be read).
+ */
+std::string readFile(const std::filesystem::path &path)
+{
+    std::ifstream fs(path, std::ios::binary);
+    std::string content;
+
+    fs.seekg(0, std::ios::end);
+    std::streamoff size = fs.tellg();
+    if (size <= 0)
+        return content;
+
+    content.resize(size);
+    fs.seekg(0, std::ios::beg);
+    fs.read(content.data(), size);
+    content.resize(fs.gcount());
+    return content;
+}
+
+/**
+ * @brief Gets the last modification time of a file.
+ * 
+ * The value is only meaningful for comparison with other values
+ * returned by this function.
+ * 
+ * @param path: the path of file.
+ * 
+ * @return int64_t - the modification time or 0 if it cannot be determined.
+ */
+int64_t getFileModifiedTime(const std::filesystem::path &path)
+{
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return 0;
+
+    return time.time_since_epoch().count();
+}
+
+/**
+ * @brief Gets the size of a file.
+ * 
+ * @param path: the path of file.
+ * 
+ * @return uint64_t - the size in bytes or 0 if it cannot be determined.
+ */
+uint64_t getFileSize(const std::filesystem::path &path)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return 0;
+
+    return size;
+}
+
+/**
+ * @brief The stream that log() writes messages to.
+ * 
+ * Programs that write their output to standard output (e.g. the command line
+ * interface) set this to std::cerr so that messages are kept out of it.
+ */
+std::ostream* log_stream = &std::cout;
+
 /**
  * @brief Logs a message in console.
  * 
+ * This function is safe to call from multiple threads.
+ * 
  * @param msg: the message to output.
  * @param scope: the scope of log message (default e.g. INFO)
  * @param add_prefix: whether to add Search100 prefix (default: true)
@@ -69,20 +164,24 @@ void log(
     bool newline = true
 )
 {
+    static std::mutex log_mutex;
+
     std::string prefix = "";
     if (indent)
         prefix.replace(0, indent - 1, "\t");
     if (add_prefix)
         prefix += "[Search100] ";
 
+    std::lock_guard<std::mutex> lock(log_mutex);
+
     if (!scope.length())
-        std::cout << prefix;
+        *log_stream << prefix;
     else
-        std::cout << prefix << "[" << scope << "] ";
+        *log_stream << prefix << "[" << scope << "] ";
 
-    std::cout << msg;
+    *log_stream << msg;
     if (newline)
-        std::cout << std::endl;
+        *log_stream << std::endl;
 }
 
 // On Windows, paths use backslash as delimiter while on most other (Linux based) operating
@@ -21,6 +21,12 @@
 #include <string>
 #include "src/utils.cpp"
 #include "src/stemming.cpp"
+#include "src/segment.cpp"
+#include "src/scoring.cpp"
+#include "src/query.cpp"
+#include "src/result_cache.cpp"
+#include "src/thread_pool.cpp"
+#include "src/http.cpp"
 
 #define IS_EQ(x, y) { if (x != y) { std::cout << __FUNCTION__ << " failed on line " << __LINE__ << " (" << x << " != " << y << ")" << std::endl; }}
 
@@ -52,11 +58,6 @@ void testStringToLower()
 class TestablePorterStemmer: public PorterStemmer {
     public:
 
-    void setData(std::string input)
-    {
-        data = stringToLower(input);
-    }
-
     void testIsConstant()
     {
         setData("syiygaeiou");
@@ -149,21 +150,21 @@ class TestablePorterStemmer: public PorterStemmer {
     {
         setData(input);
         step1a();
-        return data;
+        return getData();
     }
 
     std::string step1bWithData(std::string input)
     {
         setData(input);
         step1b();
-        return data;
+        return getData();
     }
 
     std::string step1cWithData(std::string input)
     {
         setData(input);
         step1c();
-        return data;
+        return getData();
     }
 
     void testStep1()
@@ -199,7 +200,7 @@ class TestablePorterStemmer: public PorterStemmer {
     {
         setData(input);
         step2();
-        return data;
+        return getData();
     }
 
     void testStep2()
@@ -231,7 +232,7 @@ class TestablePorterStemmer: public PorterStemmer {
     {
         setData(input);
         step3();
-        return data;
+        return getData();
     }
 
     void testStep3()
@@ -249,7 +250,7 @@ class TestablePorterStemmer: public PorterStemmer {
     {
         setData(input);
         step4();
-        return data;
+        return getData();
     }
 
     void testStep4()
@@ -279,14 +280,14 @@ class TestablePorterStemmer: public PorterStemmer {
     {
         setData(input);
         step5a();
-        return data;
+        return getData();
     }
 
     std::string step5bWithData(std::string input)
     {
         setData(input);
         step5b();
-        return data;
+        return getData();
     }
 
     void testStep5()
@@ -299,8 +300,25 @@ class TestablePorterStemmer: public PorterStemmer {
         IS_EQ(step5bWithData("roll"), "roll");
     }
 
-    // TODO: write tests for stemLine
-    // - Must test edge cases like punctuation marks, leading/trailing/multiple spaces
+    std::string stemLineToString(std::string input)
+    {
+        std::string result;
+        for (Stem &stem : stemLine(input))
+            result += std::to_string(stem.index) + ":" + stem.original + ":" + stem.stemmed + " ";
+
+        return result;
+    }
+
+    void testStemLine()
+    {
+        IS_EQ(stemLineToString(""), "");
+        IS_EQ(stemLineToString(" \t\r\n "), "");
+        IS_EQ(stemLineToString("  The dogs, barked!  "), "2:The:the 6:dogs:dog 12:barked:bark ");
+        IS_EQ(stemLineToString("hello#world"), "0:hello:hello 6:world:world ");
+        IS_EQ(stemLineToString("big   cats...ran"), "0:big:big 6:cats:cat 13:ran:ran ");
+        IS_EQ(stemLineToString("of the an it"), "");
+        IS_EQ(stemLineToString("\tcats\tdogs\r\n"), "1:cats:cat 6:dogs:dog ");
+    }
 };
 
 void testPorterStemmer()
@@ -317,6 +335,352 @@ void testPorterStemmer()
     stemmer.testStep3();
     stemmer.testStep4();
     stemmer.testStep5();
+    stemmer.testStemLine();
+}
+
+void testStemCache()
+{
+    StemCache cache(STEM_CACHE_SHARDS);
+    PorterStemmer stemmer(&cache);
+
+    IS_EQ(stemmer.stemLine("Running running RUNNING")[2].stemmed, "run");
+    IS_EQ(cache.getHits(), 2);
+    IS_EQ(cache.getMisses(), 1);
+
+    // Each shard holds a single word so not all of these are cached.
+    for (Stem &stem : stemmer.stemLine("connected connecting connection connections connects"))
+        IS_EQ(stem.stemmed, "connect");
+
+    cache.clear();
+    IS_EQ(cache.getHits(), 0);
+    IS_EQ(stemmer.stemLine("running")[0].stemmed, "run");
+    IS_EQ(cache.getMisses(), 1);
+}
+
+/* -- src/segment.cpp -- */
+
+void testSegmentRoundTrip()
+{
+    std::string filename = "test_segment.s100";
+    InvertedIndex index;
+    PorterStemmer stemmer;
+    std::string lines[] = {"connected dogs", "Connection failed", "connecting"};
+
+    for (int document_id = 0; document_id < 300; document_id++)
+    {
+        std::vector<std::pair<uint32_t, IndexedPosition>> occurrences;
+        for (Stem stem : stemmer.stemLine(lines[document_id % 3]))
+        {
+            IndexedPosition position;
+            position.index = stem.index;
+            position.surface_id = index.getSurfaceId(stem.original);
+            occurrences.emplace_back(index.getTermId(stem.stemmed), position);
+        }
+
+        index.documents[document_id].path = "corpus/" + std::to_string(document_id) + ".txt";
+        index.addOccurrences(document_id, occurrences);
+    }
+
+    index.documents[1].content_hash = 42;
+    IS_EQ(writeSegment(filename, index), true);
+
+    IndexSegment segment;
+    IS_EQ(segment.open(filename), true);
+    IS_EQ(segment.documentCount(), 300);
+    IS_EQ(segment.documentPath(1).string(), "corpus/1.txt");
+    IS_EQ(segment.documentInfo(1).content_hash, 42);
+    IS_EQ(segment.documentTermCount(0), 2);
+    IS_EQ(segment.documentTokenCount(0), 2);
+    IS_EQ(segment.documentInfo(2).token_count, 1);
+    IS_EQ(segment.surfaceCount(), 5);
+    IS_EQ((segment.findTerm("missing") == nullptr), true);
+
+    const SegmentTerm* term = segment.findTerm("connect");
+    IS_EQ((term != nullptr), true);
+    IS_EQ(term->document_frequency, 300);
+    IS_EQ(term->idf, 0.0);
+    IS_EQ(segment.findTerm("dog")->idf, std::log(3.0));
+    IS_EQ(segment.termBlockCount(*term), 3);
+
+    SegmentPosting posting;
+    IS_EQ(segment.findPosting(*term, 256, posting), true);
+    IS_EQ(posting.document_id, 256);
+
+    auto occurrences = segment.occurrences(*term, posting);
+    IS_EQ(occurrences.size(), 1);
+    IS_EQ(segment.surfaceString(occurrences[0].surface_id), "Connection");
+    IS_EQ(segment.termString(segment.termAt(occurrences[0].term_id)), "connect");
+    IS_EQ(occurrences[0].index, 0);
+
+    const SegmentTerm* dog = segment.findTerm("dog");
+    IS_EQ(segment.findPosting(*dog, 256, posting), false);
+
+    PostingCursor cursor(segment, *dog);
+    IS_EQ(cursor.advance(250), true);
+    IS_EQ(cursor.document(), 252);
+
+    int count = 0;
+    for (; !cursor.atEnd(); cursor.next())
+        count++;
+    IS_EQ(count, 16);
+
+    IS_EQ(term->max_term_frequency, 1.0f);
+    IS_EQ(dog->max_term_frequency, 0.5f);
+
+    PostingCursor pruned(segment, *term);
+    IS_EQ(pruned.skipBlocks([](const SegmentPostingBlock &block) { return block.max_term_frequency < 1.0f; }), true);
+    IS_EQ(pruned.document(), 0);
+    IS_EQ(pruned.skipBlocks([](const SegmentPostingBlock &block) { return block.max_term_frequency < 2.0f; }), false);
+    IS_EQ(pruned.atEnd(), true);
+
+    segment.close();
+    std::filesystem::remove(filename);
+}
+
+void testIntersectSorted()
+{
+    uint32_t a[] = {1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21};
+    uint32_t b[] = {2, 3, 4, 5, 6, 13, 14, 21};
+    uint32_t out[8];
+
+    IS_EQ(intersectSorted(a, 11, b, 8, out), 4);
+    IS_EQ(out[0], 3);
+    IS_EQ(out[1], 5);
+    IS_EQ(out[2], 13);
+    IS_EQ(out[3], 21);
+    IS_EQ(intersectSorted(a, 11, b, 0, out), 0);
+
+    auto value = [&a](uint32_t i) { return a[i]; };
+    IS_EQ(gallopingSearch(0, 11, 0, value), 0);
+    IS_EQ(gallopingSearch(0, 11, 12, value), 6);
+    IS_EQ(gallopingSearch(7, 11, 12, value), 7);
+    IS_EQ(gallopingSearch(0, 11, 21, value), 10);
+    IS_EQ(gallopingSearch(0, 11, 22, value), 11);
+}
+
+/* -- src/scoring.cpp -- */
+
+void testScorers()
+{
+    std::string filename = "test_scoring.s100";
+    InvertedIndex index;
+    PorterStemmer stemmer;
+    std::string lines[] = {"dogs bark", "dogs dogs dogs run", "cats sleep", "dog"};
+
+    for (int document_id = 0; document_id < 4; document_id++)
+    {
+        std::vector<std::pair<uint32_t, IndexedPosition>> occurrences;
+        for (Stem stem : stemmer.stemLine(lines[document_id]))
+        {
+            IndexedPosition position;
+            position.surface_id = index.getSurfaceId(stem.original);
+            occurrences.emplace_back(index.getTermId(stem.stemmed), position);
+        }
+
+        index.documents[document_id].path = std::to_string(document_id) + ".txt";
+        index.addOccurrences(document_id, occurrences);
+    }
+
+    IS_EQ(writeSegment(filename, index), true);
+
+    IndexSegment segment;
+    IS_EQ(segment.open(filename), true);
+    IS_EQ(segment.averageDocumentLength(), 2.25);
+
+    const SegmentTerm* dog = segment.findTerm("dog");
+    SegmentPosting posting;
+    IS_EQ(segment.findPosting(*dog, 1, posting), true);
+
+    TfIdfScorer tf_idf(segment);
+    IS_EQ(tf_idf.computeTfIdf(*dog, posting), std::log(4.0 / 3.0) * 3 / 2);
+
+    BM25Scorer bm25(segment, 1.2, 0.75);
+    double weight = bm25.termWeight(*dog);
+    IS_EQ(weight, std::log(1 + 1.5 / 3.5));
+    double expected = weight * 3 * 2.2 / (3 + 1.2 * (0.25 + 0.75 * 4 / 2.25));
+    IS_EQ((std::abs(bm25.score(weight, posting) - expected) < 1e-12), true);
+
+    for (PostingCursor cursor(segment, *dog); !cursor.atEnd(); cursor.next())
+    {
+        IS_EQ((bm25.score(weight, cursor.posting()) <= bm25.maxScore(weight, *dog)), true);
+        IS_EQ((tf_idf.score(tf_idf.termWeight(*dog), cursor.posting()) <= tf_idf.maxScore(tf_idf.termWeight(*dog), *dog)), true);
+    }
+
+    segment.close();
+    std::filesystem::remove(filename);
+}
+
+/* -- src/query.cpp -- */
+
+void testParseQuery()
+{
+    PorterStemmer stemmer;
+    QueryNode query = parseQuery("\"terms of the license\" dogs NEAR/2 cats birds", stemmer);
+
+    IS_EQ((query.type == QueryOperator::AND), true);
+    IS_EQ(query.children.size(), 3);
+    IS_EQ(query.children[2].term.stemmed, "bird");
+
+    ProximityClause near = query.children[1].clause;
+    IS_EQ(near.phrase, false);
+    IS_EQ(near.distance, 2);
+    IS_EQ(near.terms[0].stemmed, "dog");
+    IS_EQ(near.terms[1].stemmed, "cat");
+
+    ProximityClause phrase = query.children[0].clause;
+    IS_EQ(phrase.phrase, true);
+    IS_EQ(phrase.terms.size(), 2);
+    IS_EQ(phrase.terms[1].position - phrase.terms[0].position, 3);
+
+    IS_EQ((parseQuery("NEAR/3 dogs", stemmer).type == QueryOperator::TERM), true);
+    IS_EQ(parseQuery("\"unterminated phrase", stemmer).clause.terms.size(), 2);
+    IS_EQ(parseQuery("the AND (of)", stemmer).empty(), true);
+
+    // Explicit operators bind looser than words joined by default operator.
+    query = parseQuery("(kernel OR driver) AND NOT staging", stemmer, false);
+    IS_EQ((query.type == QueryOperator::AND), true);
+    IS_EQ((query.children[0].type == QueryOperator::OR), true);
+    IS_EQ((query.children[1].type == QueryOperator::NOT), true);
+    IS_EQ(query.searchedTerms().size(), 2);
+
+    query = parseQuery("kernel driver NOT staging OR usb", stemmer, false);
+    IS_EQ((query.type == QueryOperator::OR), true);
+    IS_EQ((query.children[0].type == QueryOperator::AND), true);
+    IS_EQ((query.children[0].children[0].type == QueryOperator::OR), true);
+    IS_EQ(query.children[1].term.stemmed, "usb");
+
+    QueryOperator flat;
+    IS_EQ(parseQuery("kernel OR driver usb", stemmer, false).isFlat(flat), true);
+    IS_EQ((flat == QueryOperator::OR), true);
+    IS_EQ(parseQuery("NOT NOT kernel", stemmer).isFlat(flat), true);
+    IS_EQ(parseQuery("kernel NOT driver", stemmer).isFlat(flat), false);
+
+    // Positions of "term" and "licens" in a document.
+    SegmentPosition terms[] = {{0, 0, 0, 1}, {0, 0, 0, 8}};
+    SegmentPosition licenses[] = {{0, 0, 0, 5}, {0, 0, 0, 11}, {0, 0, 0, 20}};
+
+    IS_EQ(matchClause(phrase, {{terms, 2}, {licenses, 3}}), true);
+    IS_EQ(matchClause(phrase, {{terms, 1}, {licenses, 3}}), false);
+    IS_EQ(matchClause(phrase, {{terms, 2}, {licenses + 2, 1}}), false);
+
+    near.distance = 3;
+    IS_EQ(matchClause(near, {{licenses, 3}, {terms, 2}}), true);
+    near.distance = 2;
+    IS_EQ(matchClause(near, {{licenses, 3}, {terms, 2}}), false);
+}
+
+/* -- src/result_cache.cpp -- */
+
+void testResultCache()
+{
+    ResultCache<std::string> cache(1000);
+    size_t entry_size = 300;
+
+    cache.setGeneration(1);
+    cache.insert("a", 1, std::make_shared<std::string>("A"), entry_size);
+    cache.insert("b", 1, std::make_shared<std::string>("B"), entry_size);
+    IS_EQ(*cache.find("a"), "A");
+    IS_EQ((cache.find("c") == nullptr), true);
+    IS_EQ(cache.getHits(), 1);
+    IS_EQ(cache.getMisses(), 1);
+
+    // "b" is least recently used so it is evicted first.
+    cache.insert("c", 1, std::make_shared<std::string>("C"), entry_size);
+    IS_EQ(cache.getCount(), 2);
+    IS_EQ((cache.find("b") == nullptr), true);
+    IS_EQ(*cache.find("a"), "A");
+
+    // Values that are too large or stale are not cached.
+    cache.insert("d", 1, std::make_shared<std::string>("D"), 2000);
+    cache.insert("e", 0, std::make_shared<std::string>("E"), entry_size);
+    IS_EQ(cache.getCount(), 2);
+
+    cache.setGeneration(2);
+    IS_EQ(cache.getCount(), 0);
+    IS_EQ(cache.getSize(), 0);
+
+    cache.insert("a", 2, std::make_shared<std::string>("A2"), entry_size);
+    IS_EQ(*cache.find("a"), "A2");
+    cache.setCapacity(0);
+    IS_EQ(cache.getCount(), 0);
+
+    cache.clear();
+    IS_EQ(cache.getHits(), 0);
+}
+
+/* -- src/thread_pool.cpp -- */
+
+void testThreadPool()
+{
+    ThreadPool pool(3);
+    std::vector<int> values(100, 0);
+
+    IS_EQ(pool.size(), 4);
+    pool.run(values.size(), [&values](size_t i) { values[i] = i; });
+    IS_EQ(std::accumulate(values.begin(), values.end(), 0), 4950);
+
+    bool thrown = false;
+    try
+    {
+        pool.run(10, [](size_t i) { if (i == 5) throw std::runtime_error("task"); });
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+
+    IS_EQ(thrown, true);
+}
+
+/* -- src/http.cpp -- */
+
+void testDecodeUrlComponent()
+{
+    IS_EQ(decodeUrlComponent("free+software"), "free software");
+    IS_EQ(decodeUrlComponent("%22free%20software%22"), "\"free software\"");
+    IS_EQ(decodeUrlComponent("NEAR%2F5"), "NEAR/5");
+    IS_EQ(decodeUrlComponent("%2b"), "+");
+
+    // Invalid or truncated escapes are kept as they are.
+    IS_EQ(decodeUrlComponent("%zz"), "%zz");
+    IS_EQ(decodeUrlComponent("100%"), "100%");
+    IS_EQ(decodeUrlComponent("%4"), "%4");
+}
+
+void testParseHttpRequest()
+{
+    HttpRequest request;
+    size_t content_length;
+
+    IS_EQ(parseHttpRequest("GET /search?q=free+software&limit=5&strategy HTTP/1.1\r\nHost: localhost",
+                           request, content_length), true);
+    IS_EQ(request.method, "GET");
+    IS_EQ(request.path, "/search");
+    IS_EQ(request.params["q"], "free software");
+    IS_EQ(request.params["limit"], "5");
+    IS_EQ(request.params.count("strategy"), 1);
+    IS_EQ(request.keep_alive, true);
+    IS_EQ(content_length, 0);
+
+    request = HttpRequest();
+    IS_EQ(parseHttpRequest("POST /reindex HTTP/1.0\r\nContent-Length:  12 ", request, content_length), true);
+    IS_EQ(request.keep_alive, false);
+    IS_EQ(content_length, 12);
+
+    request = HttpRequest();
+    IS_EQ(parseHttpRequest("GET / HTTP/1.1\r\nConnection: Close", request, content_length), true);
+    IS_EQ(request.keep_alive, false);
+
+    // Malformed request lines.
+    IS_EQ(parseHttpRequest("hello", request, content_length), false);
+    IS_EQ(parseHttpRequest("GET /", request, content_length), false);
+    IS_EQ(parseHttpRequest("GET / HTTP/2.0", request, content_length), false);
+
+    // Content-Length must be a number of at most nine digits; chunked bodies are not supported.
+    IS_EQ(parseHttpRequest("GET / HTTP/1.1\r\nContent-Length: 1234567890", request, content_length), false);
+    IS_EQ(parseHttpRequest("GET / HTTP/1.1\r\nContent-Length: -1", request, content_length), false);
+    IS_EQ(parseHttpRequest("GET / HTTP/1.1\r\nContent-Length: 1\xb2", request, content_length), false);
+    IS_EQ(parseHttpRequest("GET / HTTP/1.1\r\nTransfer-Encoding: chunked", request, content_length), false);
 }
 
 // Runner
@@ -325,4 +689,13 @@ int main()
     testStringToLower();
     testStringEndsWith();
     testPorterStemmer();
+    testStemCache();
+    testSegmentRoundTrip();
+    testIntersectSorted();
+    testScorers();
+    testParseQuery();
+    testResultCache();
+    testThreadPool();
+    testDecodeUrlComponent();
+    testParseHttpRequest();
 }